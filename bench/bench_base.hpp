@@ -0,0 +1,11 @@
+#include "../module_fingerprint.hpp"
+
+class bench_base {
+    public:
+        bench_base() {}
+        virtual ~bench_base() {}
+
+        virtual int getInt() = 0;
+};
+
+MODULEPP_DECLARE_BASE(bench_base, 1)
@@ -0,0 +1,223 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../module_library.hpp"
+#include "bench_base.hpp"
+
+using namespace modulepp;
+
+/**
+ * Benchmark harness for the loader hot paths.
+ *
+ * Usage: bench <plugin directory> [iterations]
+ *
+ * Each line reports one measurement as name, parameters and value, so runs can be diffed
+ * against each other to spot regressions.
+ */
+
+typedef class_loader<bench_base> loader_t;
+typedef std::chrono::steady_clock bench_clock;
+
+namespace {
+    /** Results of the measured calls, keeps the compiler from dropping them */
+    std::atomic<long> sink(0);
+
+    /** Returns the seconds passed since start */
+    double since(bench_clock::time_point start) {
+        return std::chrono::duration<double>(bench_clock::now() - start).count();
+    }
+
+    /** Prints one measurement */
+    void report(const char* name, const std::string& params, double value, const char* unit) {
+        std::printf("%-20s %-28s %14.1f %s\n", name, params.c_str(), value, unit);
+    }
+
+    /** Returns the names of all classes provided by the loader */
+    std::vector<std::string> classNames(const loader_t& loader) {
+        std::vector<std::string> result;
+        for (auto it = loader.begin(); it != loader.end(); ++it) {
+            for (auto c = it->second->begin(); c != it->second->end(); ++c) {
+                result.push_back(c.id());
+            }
+        }
+        return result;
+    }
+
+    /** Returns count indices into names in random order, repeating names as necessary */
+    std::vector<std::size_t> randomOrder(std::size_t names, std::size_t count) {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<std::size_t> dist(0, names - 1);
+
+        std::vector<std::size_t> result(count);
+        for (std::size_t& i : result) {
+            i = dist(rng);
+        }
+        return result;
+    }
+
+    /** Returns 1, factor, factor^2, ... up to and including max */
+    std::vector<std::size_t> steps(std::size_t max, std::size_t factor) {
+        std::vector<std::size_t> result;
+        for (std::size_t i = 1; i < max; i *= factor) {
+            result.push_back(i);
+        }
+        result.push_back(max);
+        return result;
+    }
+
+    /** Measures loading libraries one by one and in parallel */
+    void benchLoad(const std::vector<std::string>& paths) {
+        for (std::size_t count : steps(paths.size(), 4)) {
+            loader_t loader;
+            bench_clock::time_point start = bench_clock::now();
+            for (std::size_t i = 0; i < count; ++i) {
+                loader.load(paths[i]);
+            }
+            report("load", "libs=" + std::to_string(count), count / since(start), "libs/s");
+        }
+
+        loader_t loader;
+        bench_clock::time_point start = bench_clock::now();
+        loader.load_all(paths);
+        report("load_all", "libs=" + std::to_string(paths.size()), paths.size() / since(start), "libs/s");
+    }
+
+    /** Measures has and create latency while the number of loaded libraries grows */
+    void benchLookup(const std::vector<std::string>& paths, std::size_t iterations) {
+        loader_t loader;
+        std::size_t loaded = 0;
+
+        for (std::size_t count : steps(paths.size(), 2)) {
+            for (; loaded < count; ++loaded) {
+                loader.load(paths[loaded]);
+            }
+
+            std::vector<std::string> names = classNames(loader);
+            std::vector<std::size_t> order = randomOrder(names.size(), iterations);
+            std::string params = "libs=" + std::to_string(count) + " classes=" + std::to_string(names.size());
+
+            long found = 0;
+            bench_clock::time_point start = bench_clock::now();
+            for (std::size_t i : order) {
+                found += loader.has(names[i]);
+            }
+            report("has", params, since(start) * 1e9 / iterations, "ns/op");
+
+            start = bench_clock::now();
+            for (std::size_t i = 0; i < iterations; ++i) {
+                found += loader.has("bench_missing");
+            }
+            report("has_miss", params, since(start) * 1e9 / iterations, "ns/op");
+
+            for (int cached = 0; cached < 2; ++cached) {
+                loader.set_thread_cache(cached != 0);
+                start = bench_clock::now();
+                for (std::size_t i : order) {
+                    bench_base* b = loader.create(names[i]);
+                    found += b->getInt();
+                    delete b;
+                }
+                report(cached ? "create_cached" : "create", params, since(start) * 1e9 / iterations, "ns/op");
+            }
+            loader.set_thread_cache(false);
+            loader_t::clear_thread_cache();
+
+            sink += found;
+        }
+    }
+
+    /** Measures create throughput with all libraries loaded from 1 up to 64 threads */
+    void benchScaling(const std::vector<std::string>& paths, std::size_t iterations) {
+        loader_t loader;
+        loader.load_all(paths);
+
+        std::vector<std::string> names = classNames(loader);
+        std::vector<std::size_t> order = randomOrder(names.size(), iterations);
+
+        for (int cached = 0; cached < 2; ++cached) {
+            loader.set_thread_cache(cached != 0);
+
+            for (std::size_t threads : steps(64, 2)) {
+                std::atomic<std::size_t> ready(0);
+                std::atomic<bool> go(false);
+                std::vector<std::thread> workers;
+
+                for (std::size_t t = 0; t < threads; ++t) {
+                    workers.emplace_back([&]() {
+                        ++ready;
+                        while (!go.load(std::memory_order_acquire))
+                            std::this_thread::yield();
+
+                        long found = 0;
+                        for (std::size_t i : order) {
+                            bench_base* b = loader.create(names[i]);
+                            found += b->getInt();
+                            delete b;
+                        }
+                        loader_t::clear_thread_cache();
+                        sink += found;
+                    });
+                }
+
+                while (ready.load() != threads)
+                    std::this_thread::yield();
+
+                bench_clock::time_point start = bench_clock::now();
+                go.store(true, std::memory_order_release);
+                for (std::thread& w : workers) {
+                    w.join();
+                }
+
+                report(cached ? "create_mt_cached" : "create_mt", "threads=" + std::to_string(threads),
+                    threads * iterations / since(start), "ops/s");
+            }
+        }
+    }
+
+    /** Measures unloading and loading a library again as well as reloading it in place */
+    void benchReload(const std::vector<std::string>& paths, std::size_t iterations) {
+        loader_t loader;
+        loader.load(paths[0]);
+
+        std::size_t cycles = std::max<std::size_t>(iterations / 1000, 10);
+        bench_clock::time_point start = bench_clock::now();
+        for (std::size_t i = 0; i < cycles; ++i) {
+            loader.unload(paths[0]);
+            loader.load(paths[0]);
+        }
+        report("unload_load", "cycles=" + std::to_string(cycles), since(start) * 1e6 / cycles, "us/op");
+
+        start = bench_clock::now();
+        for (std::size_t i = 0; i < cycles; ++i) {
+            loader.reload(paths[0]);
+        }
+        report("reload", "cycles=" + std::to_string(cycles), since(start) * 1e6 / cycles, "us/op");
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <plugin directory> [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> paths = shared_library::listLibraries(argv[1]);
+    std::size_t iterations = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 100000;
+    if (paths.empty() || iterations == 0) {
+        std::fprintf(stderr, "no plugins found in %s\n", argv[1]);
+        return 1;
+    }
+
+    benchLoad(paths);
+    benchLookup(paths, iterations);
+    benchScaling(paths, iterations);
+    benchReload(paths, iterations);
+
+    return (sink.load() != 0) ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#include <string>
+
+#include "../module_header.hpp"
+#include "bench_base.hpp"
+
+// compiled once per plugin by Makefile.unix, BENCH_PLUGIN numbers the plugin
+#ifndef BENCH_PLUGIN
+    #define BENCH_PLUGIN 1
+#endif
+
+#ifndef BENCH_CLASSES
+    #define BENCH_CLASSES 32
+#endif
+
+namespace {
+    // local to the plugin, plugins are loaded with global symbol scope
+    template <int I>
+    class bench_class : public bench_base {
+        public:
+            int getInt() {
+                return BENCH_PLUGIN * 100000 + I;
+            }
+    };
+
+    // exports bench_class<1> to bench_class<I> as bench_<plugin>_<i>
+    template <int I>
+    struct exporter {
+        static void run(modulepp::factory<std::string, bench_base>* f) {
+            exporter<I - 1>::run(f);
+            f->insert("bench_" + std::to_string(BENCH_PLUGIN) + "_" + std::to_string(I),
+                new modulepp::factoryCreatorBasic<bench_base, bench_class<I>>());
+        }
+    };
+
+    template <>
+    struct exporter<0> {
+        static void run(modulepp::factory<std::string, bench_base>*) {}
+    };
+}
+
+BEGIN_MODULE_FACTORY(bench_base)
+    exporter<BENCH_CLASSES>::run(modFactory);
+END_MODULE_FACTORY
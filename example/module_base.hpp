@@ -1,3 +1,5 @@
+#include "../module_fingerprint.hpp"
+
 class module_base {
     public:
         module_base() {}
@@ -5,3 +7,5 @@ class module_base {
     
         virtual int getInt() = 0;
 };
+
+MODULEPP_DECLARE_BASE(module_base, 1)
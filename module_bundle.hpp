@@ -0,0 +1,421 @@
+/**
+ * @file module_bundle.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_BUNDLE_HPP_
+#define _MODULEPP_MODULE_BUNDLE_HPP_
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "module_library_exceptions.hpp"
+#include "module_probe.hpp"
+
+#if defined(_WIN32)
+    #include <Windows.h>
+#else
+    #include <cerrno>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #if defined(__linux__) && defined(MFD_CLOEXEC)
+        #include <dlfcn.h>
+        #define MODULEPP_BUNDLE_MEMFD
+    #endif
+#endif
+
+namespace modulepp {
+    /** Magic number of bundle files, "MPPB" */
+    static const std::uint32_t BUNDLE_MAGIC = 0x4250504d;
+
+    /** Version of the bundle format */
+    static const std::uint32_t BUNDLE_VERSION = 1;
+
+    /** Alignment of the library images in a bundle */
+    static const std::uint64_t BUNDLE_ALIGNMENT = 4096;
+
+    /**
+     * Header leading a bundle file.
+     *
+     * The header is followed by the library table, the class table, the strings and the page aligned
+     * library images. All fields are in the byte order of the writer.
+     */
+    struct bundleHeader {
+        /** BUNDLE_MAGIC */
+        std::uint32_t magic;
+        /** BUNDLE_VERSION */
+        std::uint32_t version;
+        /** Number of libraries */
+        std::uint32_t libraries;
+        /** Number of classes of all libraries */
+        std::uint32_t classes;
+        /** Offset of the strings in the file */
+        std::uint64_t stringsOffset;
+        /** Size of the strings */
+        std::uint64_t stringsSize;
+    };
+
+    /** Library table entry of a bundle, string offsets are relative to the strings. */
+    struct bundleLibrary {
+        /** Offset of the library image in the file */
+        std::uint64_t dataOffset;
+        /** Size of the library image */
+        std::uint64_t dataSize;
+        /** fingerprint_of the base class from the manifest, 0 if the library has none */
+        std::uint64_t fingerprint;
+        /** FACTORY_ABI_VERSION from the manifest, 0 if the library has none */
+        std::uint32_t abiVersion;
+        /** Offset of the name */
+        std::uint32_t nameOffset;
+        /** Size of the name without the terminator */
+        std::uint32_t nameSize;
+        /** Index of the first class in the class table */
+        std::uint32_t firstClass;
+        /** Number of classes */
+        std::uint32_t classCount;
+        /** Reserved, 0 */
+        std::uint32_t reserved;
+    };
+
+    /** Class table entry of a bundle, the string offset is relative to the strings. */
+    struct bundleClass {
+        /** Offset of the name */
+        std::uint32_t nameOffset;
+        /** Size of the name without the terminator */
+        std::uint32_t nameSize;
+    };
+
+    /** Library to pack into a bundle, see write_bundle. */
+    struct bundle_source {
+        /** Name of the library in the bundle, it is loaded as "<bundle>/<name>" */
+        std::string name;
+        /** Path of the library file, including the suffix */
+        std::string file;
+        /** Names of the classes the library provides, read from its manifest if empty */
+        std::vector<std::string> classes;
+    };
+
+    /** Library contained in a bundle, see bundle_image. */
+    struct bundle_member {
+        /** Name of the library in the bundle */
+        std::string name;
+        /** Names of the classes the library provides */
+        std::vector<std::string> classes;
+        /** FACTORY_ABI_VERSION from the manifest, 0 if the library has none */
+        std::uint32_t version;
+        /** fingerprint_of the base class from the manifest, 0 if the library has none */
+        std::uint64_t fingerprint;
+        /** Library image, points into the mapped bundle */
+        const unsigned char* data;
+        /** Size of the library image */
+        std::size_t size;
+    };
+
+    /**
+     * Packs libraries into a single bundle file, see class_loader::load_bundle.
+     *
+     * Libraries given without classes are probed, throws libraryProbeException if they export no manifest.
+     * Throws libraryBundleException if a library cannot be read or the bundle cannot be written.
+     */
+    inline void write_bundle(const std::string& output, const std::vector<bundle_source>& sources) {
+        std::vector<bundleLibrary> libraries(sources.size());
+        std::vector<bundleClass> classes;
+        std::vector<std::string> images(sources.size());
+        std::string strings;
+
+        auto addString = [&strings](const std::string& s, std::uint32_t& offset, std::uint32_t& size) {
+            offset = static_cast<std::uint32_t>(strings.size());
+            size = static_cast<std::uint32_t>(s.size());
+            strings.append(s).push_back('\0');
+        };
+
+        for (std::size_t i = 0; i < sources.size(); ++i) {
+            const bundle_source& source = sources[i];
+            bundleLibrary& library = libraries[i];
+            std::memset(&library, 0, sizeof(library));
+
+            std::vector<std::string> names = source.classes;
+            if (names.empty()) {
+                library_metadata metadata = probe_library(source.file);
+                names = metadata.classes;
+                library.fingerprint = metadata.fingerprint;
+                library.abiVersion = metadata.version;
+            }
+
+            std::ifstream in(source.file.c_str(), std::ios::binary);
+            std::ostringstream contents;
+            if (!in || !(contents << in.rdbuf()))
+                throw libraryBundleException();
+            images[i] = contents.str();
+
+            addString(source.name, library.nameOffset, library.nameSize);
+            library.firstClass = static_cast<std::uint32_t>(classes.size());
+            library.classCount = static_cast<std::uint32_t>(names.size());
+            for (auto &name : names) {
+                bundleClass entry;
+                addString(name, entry.nameOffset, entry.nameSize);
+                classes.push_back(entry);
+            }
+        }
+
+        bundleHeader header;
+        header.magic = BUNDLE_MAGIC;
+        header.version = BUNDLE_VERSION;
+        header.libraries = static_cast<std::uint32_t>(libraries.size());
+        header.classes = static_cast<std::uint32_t>(classes.size());
+        header.stringsOffset = sizeof(bundleHeader) + libraries.size() * sizeof(bundleLibrary) + classes.size() * sizeof(bundleClass);
+        header.stringsSize = strings.size();
+
+        std::uint64_t offset = header.stringsOffset + header.stringsSize;
+        for (std::size_t i = 0; i < libraries.size(); ++i) {
+            offset = (offset + BUNDLE_ALIGNMENT - 1) / BUNDLE_ALIGNMENT * BUNDLE_ALIGNMENT;
+            libraries[i].dataOffset = offset;
+            libraries[i].dataSize = images[i].size();
+            offset += images[i].size();
+        }
+
+        std::ofstream out(output.c_str(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(libraries.data()), libraries.size() * sizeof(bundleLibrary));
+        out.write(reinterpret_cast<const char*>(classes.data()), classes.size() * sizeof(bundleClass));
+        out.write(strings.data(), strings.size());
+
+        std::uint64_t written = header.stringsOffset + header.stringsSize;
+        for (std::size_t i = 0; i < libraries.size(); ++i) {
+            out << std::string(static_cast<std::size_t>(libraries[i].dataOffset - written), '\0');
+            out.write(images[i].data(), images[i].size());
+            written = libraries[i].dataOffset + libraries[i].dataSize;
+        }
+
+        if (!out.flush()) {
+            out.close();
+            std::remove(output.c_str());
+            throw libraryBundleException();
+        }
+    }
+
+    /**
+     * Read-only mapping of a bundle file.
+     *
+     * The index is read once when the bundle is opened, the member images point into the mapping and
+     * stay valid as long as the bundle_image.
+     */
+    class bundle_image {
+        public:
+            /** Maps a bundle file, throws libraryBundleException if it is not readable or malformed. */
+            explicit bundle_image(const std::string& file) : file(file) {
+                try {
+                    image.open(file);
+                } catch (libraryProbeException&) {
+                    throw libraryBundleException();
+                }
+                readIndex();
+            }
+
+            /** Returns the path of the bundle */
+            const std::string& path() const {
+                return file;
+            }
+
+            /** Returns the libraries of the bundle in the order they were packed */
+            const std::vector<bundle_member>& members() const {
+                return entries;
+            }
+        private:
+            /** Path of the bundle */
+            std::string file;
+            /** Mapped bundle */
+            library_image image;
+            /** Libraries of the bundle */
+            std::vector<bundle_member> entries;
+
+            /** Reads the library and class tables */
+            void readIndex() {
+                const unsigned char* data = image.bytes();
+                if (!contains(0, sizeof(bundleHeader)))
+                    throw libraryBundleException();
+
+                const bundleHeader* header = reinterpret_cast<const bundleHeader*>(data);
+                std::uint64_t tables = sizeof(bundleHeader) + std::uint64_t(header->libraries) * sizeof(bundleLibrary) +
+                    std::uint64_t(header->classes) * sizeof(bundleClass);
+                if (header->magic != BUNDLE_MAGIC || header->version != BUNDLE_VERSION || tables > header->stringsOffset ||
+                    !contains(header->stringsOffset, header->stringsSize))
+                    throw libraryBundleException();
+
+                const bundleLibrary* libraries = reinterpret_cast<const bundleLibrary*>(data + sizeof(bundleHeader));
+                const bundleClass* classes = reinterpret_cast<const bundleClass*>(libraries + header->libraries);
+                const char* strings = reinterpret_cast<const char*>(data + header->stringsOffset);
+
+                entries.resize(header->libraries);
+                for (std::size_t i = 0; i < entries.size(); ++i) {
+                    const bundleLibrary& library = libraries[i];
+                    if (!contains(library.dataOffset, library.dataSize) || library.dataSize == 0 ||
+                        std::uint64_t(library.firstClass) + library.classCount > header->classes)
+                        throw libraryBundleException();
+
+                    bundle_member& member = entries[i];
+                    member.name = readString(strings, header->stringsSize, library.nameOffset, library.nameSize);
+                    member.version = library.abiVersion;
+                    member.fingerprint = library.fingerprint;
+                    member.data = data + library.dataOffset;
+                    member.size = static_cast<std::size_t>(library.dataSize);
+
+                    member.classes.reserve(library.classCount);
+                    for (std::uint32_t j = 0; j < library.classCount; ++j) {
+                        const bundleClass& entry = classes[library.firstClass + j];
+                        member.classes.push_back(readString(strings, header->stringsSize, entry.nameOffset, entry.nameSize));
+                    }
+                }
+            }
+
+            /** Returns whether the range lies within the bundle */
+            bool contains(std::uint64_t offset, std::uint64_t size) const {
+                return offset <= image.size() && size <= image.size() - offset;
+            }
+
+            /** Returns a terminated string of the string table */
+            static std::string readString(const char* strings, std::uint64_t size, std::uint32_t offset, std::uint32_t length) {
+                if (std::uint64_t(offset) + length >= size || strings[offset + length] != '\0')
+                    throw libraryBundleException();
+                return std::string(strings + offset, length);
+            }
+
+            /** Non-Copyable */
+            bundle_image(const bundle_image&) = delete;
+    };
+
+    /**
+     * Library of a bundle written out to be opened by the platform loader.
+     *
+     * On linux the image is written to an anonymous memory file opened through /proc, elsewhere or
+     * without memfd_create to a temporary file next to the bundle. The file has to outlive the library
+     * opened from it and is released when destructed, unless the library stayed mapped.
+     */
+    class bundle_file {
+        public:
+            /**
+             * Writes out a library of a bundle, the suffix is appended to temporary files.
+             *
+             * Throws libraryBundleException if the library cannot be written.
+             */
+            bundle_file(const bundle_image& image, std::size_t member, const char* suffix) : fd(-1) {
+                const bundle_member& library = image.members()[member];
+
+                #ifdef MODULEPP_BUNDLE_MEMFD
+                fd = memfd_create(library.name.c_str(), MFD_CLOEXEC);
+                if (fd >= 0) {
+                    if (!writeAll(fd, library.data, library.size)) {
+                        ::close(fd);
+                        throw libraryBundleException();
+                    }
+                    file = "/proc/self/fd/" + std::to_string(fd);
+                    return;
+                }
+                #endif
+
+                // unique per process and extraction, the same member may be loaded by several loaders
+                static std::atomic<unsigned long> extractions(0);
+                file = image.path() + "." + std::to_string(member) + "." + std::to_string(processId()) + "." +
+                    std::to_string(++extractions) + suffix;
+
+                std::ofstream out(file.c_str(), std::ios::binary | std::ios::trunc);
+                if (!out || !out.write(reinterpret_cast<const char*>(library.data), library.size) || !out.flush()) {
+                    out.close();
+                    std::remove(file.c_str());
+                    throw libraryBundleException();
+                }
+            }
+
+            /**
+             * Destructor, closes the memory file or removes the temporary file.
+             *
+             * Memory files of libraries still mapped, because of nodelete or unique symbols pinning them, stay
+             * open. Their path would otherwise name the next descriptor reusing the number and make the
+             * platform loader hand out the old library.
+             */
+            ~bundle_file() {
+                if (fd >= 0) {
+                    #ifdef MODULEPP_BUNDLE_MEMFD
+                    void* mapped = dlopen(file.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+                    if (mapped != nullptr) {
+                        dlclose(mapped);
+                    } else {
+                        ::close(fd);
+                    }
+                    #endif
+                } else {
+                    std::remove(file.c_str());
+                }
+            }
+
+            /** Returns the path to open the library from, including the suffix */
+            const std::string& path() const {
+                return file;
+            }
+
+        private:
+            /** Path to open the library from */
+            std::string file;
+            /** Descriptor of the memory file, -1 for temporary files */
+            int fd;
+
+            /** Returns the id of the process, used to name temporary files */
+            static unsigned long processId() {
+                #if defined(_WIN32)
+                    return GetCurrentProcessId();
+                #else
+                    return static_cast<unsigned long>(getpid());
+                #endif
+            }
+
+            #ifdef MODULEPP_BUNDLE_MEMFD
+            /** Writes the whole buffer to fd, returns false on failure */
+            static bool writeAll(int fd, const unsigned char* data, std::size_t size) {
+                while (size != 0) {
+                    ssize_t n = ::write(fd, data, size);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                        return false;
+
+                    data += n;
+                    size -= static_cast<std::size_t>(n);
+                }
+                return true;
+            }
+            #endif
+
+            /** Non-Copyable */
+            bundle_file(const bundle_file&) = delete;
+    };
+}
+
+#endif /* _MODULEPP_MODULE_BUNDLE_HPP_ */
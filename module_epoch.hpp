@@ -0,0 +1,217 @@
+/**
+ * @file module_epoch.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_EPOCH_HPP_
+#define _MODULEPP_MODULE_EPOCH_HPP_
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+namespace modulepp {
+    /**
+     * Epoch based reclamation of objects replaced while readers may still use them.
+     *
+     * Readers announce the epoch they start reading in through a record of their own thread, retired
+     * objects are freed once every reader that may have seen them is done. Entering and leaving only
+     * writes to the record of the calling thread, so readers never contend with each other. Sections
+     * nest, the outermost one counts.
+     */
+    class epoch_domain {
+        public:
+            /** Returns the domain shared by all loaders of the process, it is never destroyed */
+            static epoch_domain& global() {
+                static epoch_domain* domain = new epoch_domain();
+                return *domain;
+            }
+
+            /** Starts a read section of the calling thread */
+            void enter() {
+                record& r = local();
+                if (r.depth++ != 0)
+                    return;
+
+                // objects published before the announcement are safe, the pointers to them have to be read
+                // with sequential consistency so that the announcement is ordered before
+                r.epoch.store(_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+            }
+
+            /** Ends a read section of the calling thread, frees objects it was the last to keep */
+            void leave() {
+                record& r = local();
+                if (--r.depth != 0)
+                    return;
+
+                // only sections older than a retired object keep it, they free it on their way out
+                std::uint64_t epoch = r.epoch.load(std::memory_order_relaxed);
+                r.epoch.store(0, std::memory_order_seq_cst);
+                if (epoch <= _newest.load(std::memory_order_seq_cst))
+                    collect();
+            }
+
+            /** Frees the object once no read section that may reference it is running anymore */
+            void retire(std::shared_ptr<const void> object) {
+                if (!object)
+                    return;
+
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    std::uint64_t epoch = _epoch.fetch_add(1, std::memory_order_seq_cst);
+                    _retired.push_back(retired{epoch, std::move(object)});
+                    _newest.store(epoch, std::memory_order_seq_cst);
+                }
+                collect();
+            }
+
+            /** Frees all retired objects no read section references, destructors run without holding a lock */
+            void collect() {
+                std::vector<retired> freed;
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_retired.empty())
+                        return;
+
+                    std::uint64_t active = std::numeric_limits<std::uint64_t>::max();
+                    for (record* r = _records.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+                        // either the section is seen or it reads the pointer published before retiring
+                        std::uint64_t epoch = r->epoch.load(std::memory_order_seq_cst);
+                        if (epoch != 0 && epoch < active)
+                            active = epoch;
+                    }
+
+                    // objects retired before the oldest running section started are unreachable
+                    std::uint64_t newest = 0;
+                    std::vector<retired> kept;
+                    for (auto &it : _retired) {
+                        if (it.epoch < active) {
+                            freed.push_back(std::move(it));
+                        } else {
+                            newest = (it.epoch > newest) ? it.epoch : newest;
+                            kept.push_back(std::move(it));
+                        }
+                    }
+                    _retired.swap(kept);
+                    _newest.store(newest, std::memory_order_seq_cst);
+                }
+            }
+        private:
+            /** Read state of a thread, records are reused once their thread exits */
+            struct record {
+                /** Epoch the running section started in, 0 outside of sections */
+                std::atomic<std::uint64_t> epoch;
+                /** Whether a thread owns the record */
+                std::atomic<bool> used;
+                /** Nesting depth, only touched by the owning thread */
+                unsigned depth;
+                /** Next record of the domain */
+                record* next;
+                /** keeps records of different threads on separate cache lines */
+                char padding[64];
+
+                record() : epoch(0), used(true), depth(0), next(nullptr) {}
+            };
+
+            /** Object waiting for the read sections that may reference it */
+            struct retired {
+                /** Epoch the object was retired in */
+                std::uint64_t epoch;
+                /** The object */
+                std::shared_ptr<const void> object;
+            };
+
+            /** Owner of the record of a thread, hands it back when the thread exits */
+            struct owner {
+                record* r;
+
+                owner() : r(global().acquire()) {}
+
+                ~owner() {
+                    r->epoch.store(0, std::memory_order_relaxed);
+                    r->used.store(false, std::memory_order_release);
+                }
+            };
+
+            /** Current epoch, starts at 1 */
+            std::atomic<std::uint64_t> _epoch;
+            /** Epoch of the newest retired object, 0 if there is none */
+            std::atomic<std::uint64_t> _newest;
+            /** Records of all threads that ever read */
+            std::atomic<record*> _records;
+            /** Retired objects */
+            std::vector<retired> _retired;
+            /** Mutex guarding the retired objects */
+            std::mutex _mutex;
+
+            /** Constructor */
+            epoch_domain() : _epoch(1), _newest(0), _records(nullptr) {}
+
+            /** Returns the record of the calling thread */
+            static record& local() {
+                static thread_local owner o;
+                return *o.r;
+            }
+
+            /** Takes over the record of an exited thread or adds a new one */
+            record* acquire() {
+                for (record* r = _records.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+                    bool expected = false;
+                    if (!r->used.load(std::memory_order_relaxed) && r->used.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                        return r;
+                }
+
+                record* r = new record();
+                r->next = _records.load(std::memory_order_relaxed);
+                while (!_records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {}
+                return r;
+            }
+
+            /** Non-Copyable */
+            epoch_domain(const epoch_domain&) = delete;
+    };
+
+    /** Read section of the calling thread in the global epoch_domain, see epoch_domain::enter. */
+    class epoch_guard {
+        public:
+            /** Enters the section */
+            epoch_guard() {
+                epoch_domain::global().enter();
+            }
+
+            /** Leaves the section */
+            ~epoch_guard() {
+                epoch_domain::global().leave();
+            }
+        private:
+            /** Non-Copyable */
+            epoch_guard(const epoch_guard&) = delete;
+    };
+}
+
+#endif /* _MODULEPP_MODULE_EPOCH_HPP_ */
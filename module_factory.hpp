@@ -27,10 +27,23 @@
 #ifndef _MODULEPP_MODULE_FACTORY_HPP_
 #define	_MODULEPP_MODULE_FACTORY_HPP_
 
-#include <set>
+#include <new>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
+#include <limits>
+#include <utility>
 #include <unordered_map>
 
+#if defined(__GXX_RTTI) || defined(_CPPRTTI) || defined(__cpp_rtti)
+    #define MODULEPP_RTTI 1
+    #include <typeinfo>
+#endif
+
+#include "module_string.hpp"
+#include "module_pool.hpp"
+#include "module_fingerprint.hpp"
+
 namespace modulepp {
     /** exception thrown when object cannot be created from identifier */
     class factoryException : public std::exception {
@@ -40,27 +53,186 @@ namespace modulepp {
             }
     };
 
+    /** exception thrown when an object is created with arguments its class is not exported for */
+    class factoryArgumentsException : public std::exception {
+        public:
+            virtual const char* what() const throw() {
+                return "Error creating object: arguments do not match the exported constructor.";
+            }
+    };
+
+    /** wraps a type to keep it from being deduced, arguments have to match the exported constructor exactly */
+    template <typename T>
+    struct exact_argument {
+        typedef T type;
+    };
+
     /** base template for different class creators */
     template <typename B>
     class factoryCreator {
         public:
             /** constructor */
-            factoryCreator() {}
+            constexpr factoryCreator() {}
             /** destructor */
             virtual ~factoryCreator() {}
             /** to be overloaded */
             virtual B* create() const = 0;
+            /** returns size of created objects */
+            virtual std::size_t size() const = 0;
+            /** returns alignment of created objects */
+            virtual std::size_t alignment() const = 0;
+            /** constructs an object in storage of at least size() bytes aligned to alignment() */
+            virtual B* construct(void* storage) const = 0;
+            /** destroys an object created by construct, returns its storage */
+            virtual void* destruct(B* b) const = 0;
+            /** destroys an object obtained from create */
+            virtual void destroy(B* b) const {
+                delete b;
+            }
+            /** returns an object to be handed back through recycle, creators without a pool call create */
+            virtual B* acquire() const {
+                return this->create();
+            }
+            /** returns an object like acquire placed on the given NUMA node, creators without a pool ignore the node */
+            virtual B* acquire_on(unsigned) const {
+                return this->acquire();
+            }
+            /** hands back an object obtained from acquire, creators without a pool call destroy */
+            virtual void recycle(B* b) const {
+                this->destroy(b);
+            }
+            /** returns args_fingerprint of the constructor arguments, 0 for creators of default constructed objects */
+            virtual std::uint64_t signature() const {
+                return 0;
+            }
+            /** returns whether created objects implement the interface with the given fingerprint, see fingerprint_of */
+            virtual bool implements(std::uint64_t) const {
+                return false;
+            }
+            /** returns an object created by this creator as the interface with the given fingerprint, nullptr if not implemented */
+            virtual void* query(B*, std::uint64_t) const {
+                return nullptr;
+            }
         private:
             /** noncopyable */
             factoryCreator(const factoryCreator&) = delete;
     };
 
+    /**
+     * creator of objects constructed from arguments
+     *
+     * Found through signature(), the argument-less functions of factoryCreator throw factoryArgumentsException.
+     */
+    template <typename B, typename... Args>
+    class factoryCreatorArgs : public factoryCreator<B> {
+        public:
+            using factoryCreator<B>::create;
+            using factoryCreator<B>::construct;
+
+            /** constructor */
+            constexpr factoryCreatorArgs() {}
+            /** destructor */
+            virtual ~factoryCreatorArgs() {}
+            /** returns pointer to an object newly created from the arguments */
+            virtual B* create(Args... args) const = 0;
+            /** constructs an object from the arguments in storage of at least size() bytes aligned to alignment() */
+            virtual B* construct(void* storage, Args... args) const = 0;
+            /** returns args_fingerprint<Args...>() */
+            std::uint64_t signature() const {
+                return args_fingerprint<Args...>();
+            }
+            /** returns the creator cast to the given argument list, throws if it was exported with different arguments */
+            static const factoryCreatorArgs* cast(const factoryCreator<B>* creator) {
+                if (creator->signature() != args_fingerprint<Args...>())
+                    throw factoryArgumentsException();
+
+                return static_cast<const factoryCreatorArgs*>(creator);
+            }
+        private:
+            /** noncopyable */
+            factoryCreatorArgs(const factoryCreatorArgs&) = delete;
+    };
+
+    /** creator forwarding arguments to the constructor of C */
+    template <typename B, typename C, typename... Args>
+    class factoryCreatorArgsTyped : public factoryCreatorArgs<B, Args...> {
+        public:
+            /** constructor */
+            constexpr factoryCreatorArgsTyped() {}
+            /** destructor */
+            virtual ~factoryCreatorArgsTyped() {}
+            /** returns sizeof(C) */
+            std::size_t size() const {
+                return sizeof(C);
+            }
+            /** returns alignof(C) */
+            std::size_t alignment() const {
+                return alignof(C);
+            }
+            /** throws, C is created from arguments */
+            B* create() const {
+                throw factoryArgumentsException();
+            }
+            /** throws, C is created from arguments */
+            B* construct(void*) const {
+                throw factoryArgumentsException();
+            }
+            /** returns pointer to a newly created C */
+            B* create(Args... args) const {
+                return new C(std::forward<Args>(args)...);
+            }
+            /** constructs a C in the given storage */
+            B* construct(void* storage, Args... args) const {
+                return new (storage) C(std::forward<Args>(args)...);
+            }
+            /** destroys a C without freeing its storage */
+            void* destruct(B* b) const {
+                C* c = static_cast<C*>(b);
+                c->~C();
+                return c;
+            }
+        private:
+            /** noncopyable */
+            factoryCreatorArgsTyped(const factoryCreatorArgsTyped&) = delete;
+    };
+
+    /** common base for creators of class C, implements the object layout related functions */
+    template <typename B, typename C>
+    class factoryCreatorTyped : public factoryCreator<B> {
+        public:
+            /** constructor */
+            constexpr factoryCreatorTyped() {}
+            /** destructor */
+            virtual ~factoryCreatorTyped() {}
+            /** returns sizeof(C) */
+            std::size_t size() const {
+                return sizeof(C);
+            }
+            /** returns alignof(C) */
+            std::size_t alignment() const {
+                return alignof(C);
+            }
+            /** constructs a C in the given storage */
+            B* construct(void* storage) const {
+                return new (storage) C;
+            }
+            /** destroys a C without freeing its storage */
+            void* destruct(B* b) const {
+                C* c = static_cast<C*>(b);
+                c->~C();
+                return c;
+            }
+        private:
+            /** noncopyable */
+            factoryCreatorTyped(const factoryCreatorTyped&) = delete;
+    };
+
     /** basic creator requiring you to manage the object lifetime */
     template <typename B, typename C>
-    class factoryCreatorBasic : public factoryCreator<B> {
+    class factoryCreatorBasic : public factoryCreatorTyped<B, C> {
         public:
             /** constructor */
-            factoryCreatorBasic() {}
+            constexpr factoryCreatorBasic() {}
             /** destructor */
             virtual ~factoryCreatorBasic() {}
             /** returns pointer to newly created object */
@@ -72,49 +244,294 @@ namespace modulepp {
             factoryCreatorBasic(const factoryCreatorBasic&) = delete;
     };
 
-    /** advanced creator freeing all created objects when going out of scope */
+    /**
+     * basic creator for a class C implementing the additional interfaces Is
+     *
+     * Interfaces are found by their fingerprint and reached through static casts, so querying them neither
+     * needs dynamic_cast nor RTTI.
+     */
+    template <typename B, typename C, typename... Is>
+    class factoryCreatorInterfaces : public factoryCreatorBasic<B, C> {
+        static_assert(sizeof...(Is) > 0, "At least one interface has to be listed");
+        public:
+            /** constructor */
+            constexpr factoryCreatorInterfaces() {}
+            /** destructor */
+            virtual ~factoryCreatorInterfaces() {}
+            /** returns whether C implements the interface */
+            bool implements(std::uint64_t iface) const {
+                return find(iface) != nullptr;
+            }
+            /** returns the object as the interface or nullptr */
+            void* query(B* b, std::uint64_t iface) const {
+                caster c = find(iface);
+                return (c != nullptr && b != nullptr) ? c(b) : nullptr;
+            }
+        private:
+            /** function converting an object to one of its interfaces */
+            typedef void* (*caster)(B*);
+
+            /** converts an object to interface I */
+            template <typename I>
+            static void* cast(B* b) {
+                return static_cast<I*>(static_cast<C*>(b));
+            }
+
+            /** returns the conversion to an interface or nullptr */
+            static caster find(std::uint64_t iface) {
+                static const std::uint64_t fingerprints[] = { fingerprint_of<Is>()... };
+                static const caster casts[] = { &cast<Is>... };
+
+                for (std::size_t i = 0; i < sizeof...(Is); ++i) {
+                    if (fingerprints[i] == iface)
+                        return casts[i];
+                }
+                return nullptr;
+            }
+
+            /** noncopyable */
+            factoryCreatorInterfaces(const factoryCreatorInterfaces&) = delete;
+    };
+
+    /**
+     * advanced creator freeing all created objects when going out of scope
+     *
+     * Objects are owned by the creator and must not be deleted, use destroy to free them early.
+     */
     template <typename B, typename C>
-    class factoryCreatorAdvance : public factoryCreator<B> {
+    class factoryCreatorAdvance : public factoryCreatorTyped<B, C> {
         private:
-            /** list of allocated objects for given type */
-            typedef std::set<B*> ObjectSet;
-            /** Set of objects created / to be deleted. */
-            mutable ObjectSet deleteSet;
+            /** objects created / to be deleted. */
+            mutable object_registry<C> registry;
 
             /** noncopyable */
             factoryCreatorAdvance(const factoryCreatorAdvance&) = delete;
         public:
             /** constructor */
-            factoryCreatorAdvance() : ObjectSet(), deleteSet() {}
+            factoryCreatorAdvance() : registry() {}
 
             /** destructor, deletes all created objects */
-            virtual ~factoryCreatorAdvance() {
-                for (typename ObjectSet::iterator it = deleteSet.begin();
-                    it != deleteSet.end(); ++it) {
-                    delete *it;
-                }
-            };
+            virtual ~factoryCreatorAdvance() {}
 
             /** returns pointer to newly created object */
             B* create() const {
-                B *b = new C;
-                this->deleteSet.insert(b);
-                return b;
+                return this->registry.create();
+            }
+
+            /** destroys an object before the creator goes out of scope */
+            void destroy(B* b) const {
+                this->registry.release(static_cast<C*>(b));
             }
     };
 
+    /**
+     * creator recycling objects obtained through acquire in per-node pools, create behaves like the basic creator
+     *
+     * acquire takes storage from the NUMA node of the calling thread, acquire_on from the given node.
+     */
+    template <typename B, typename C>
+    class factoryCreatorPooled : public factoryCreatorTyped<B, C> {
+        public:
+            /** constructor */
+            constexpr factoryCreatorPooled() {}
+            /** destructor */
+            virtual ~factoryCreatorPooled() {}
+            /** returns pointer to newly created object */
+            B* create() const {
+                return new C;
+            }
+            /** returns an object constructed in pooled storage of the node of the calling thread */
+            B* acquire() const {
+                return place(node_pool<C>::allocate());
+            }
+            /** returns an object constructed in pooled storage of the given node */
+            B* acquire_on(unsigned node) const {
+                return place(node_pool<C>::allocate(node));
+            }
+            /** destroys the object and returns its storage to the pool of its node */
+            void recycle(B* b) const {
+                node_pool<C>::deallocate(this->destruct(b));
+            }
+        private:
+            /** constructs a C in pooled storage */
+            static B* place(void* storage) {
+                try {
+                    return new (storage) C;
+                } catch (...) {
+                    node_pool<C>::deallocate(storage);
+                    throw;
+                }
+            }
+
+            /** noncopyable */
+            factoryCreatorPooled(const factoryCreatorPooled&) = delete;
+    };
+
+    /** deleter handing objects back to their creator, or to the arena they were constructed in */
+    template <typename B>
+    class factoryDeleter {
+        public:
+            /** constructor */
+            factoryDeleter(const factoryCreator<B>* creator = nullptr, arena* a = nullptr)
+                : _creator(creator), _arena(a) {}
+
+            /** destroys the object */
+            void operator () (B* b) const {
+                if (_arena != nullptr) {
+                    void* storage = _creator->destruct(b);
+                    _arena->deallocate(storage, _creator->size(), _creator->alignment());
+                } else {
+                    _creator->recycle(b);
+                }
+            }
+
+            /** returns the creator of the object */
+            const factoryCreator<B>* creator() const {
+                return _creator;
+            }
+        private:
+            /** creator of the object */
+            const factoryCreator<B>* _creator;
+            /** arena holding the object or nullptr */
+            arena* _arena;
+    };
+
+    /**
+     * owner of objects of one class constructed next to each other in a single allocation
+     *
+     * Objects are destroyed through their creator together with the block, in reverse order, and must
+     * not be deleted individually. The creator has to outlive the block.
+     */
+    template <typename B>
+    class factoryBlock {
+        public:
+            /** constructs an empty block */
+            factoryBlock() : _creator(nullptr), _memory(nullptr), _first(nullptr), _offset(0), _stride(0), _count(0) {}
+
+            /** constructs n objects through creator, throws std::bad_alloc if the block cannot be allocated */
+            factoryBlock(const factoryCreator<B>* creator, std::size_t n)
+                : _creator(creator), _memory(nullptr), _first(nullptr), _offset(0), _stride(0), _count(0)
+            {
+                if (n == 0)
+                    return;
+
+                const std::size_t alignment = creator->alignment();
+                _stride = (creator->size() + alignment - 1) & ~(alignment - 1);
+                if (n > (std::numeric_limits<std::size_t>::max() - alignment) / _stride)
+                    throw std::bad_alloc();
+
+                // operator new only guarantees fundamental alignment, align the first object by hand
+                _memory = ::operator new(n * _stride + alignment - 1);
+                std::uintptr_t raw = reinterpret_cast<std::uintptr_t>(_memory);
+                _first = reinterpret_cast<char*>((raw + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1));
+
+                try {
+                    for (; _count < n; ++_count) {
+                        B* b = creator->construct(_first + _count * _stride);
+                        if (_count == 0)
+                            _offset = reinterpret_cast<char*>(b) - _first;
+                    }
+                } catch (...) {
+                    clear();
+                    throw;
+                }
+            }
+
+            /** move constructor */
+            factoryBlock(factoryBlock&& b)
+                : _creator(b._creator), _memory(b._memory), _first(b._first), _offset(b._offset), _stride(b._stride), _count(b._count)
+            {
+                b._memory = nullptr;
+                b._first = nullptr;
+                b._count = 0;
+            }
+
+            /** move assignment, destroys the objects held so far */
+            factoryBlock& operator = (factoryBlock&& b) {
+                if (this != &b) {
+                    clear();
+                    std::swap(_creator, b._creator);
+                    std::swap(_memory, b._memory);
+                    std::swap(_first, b._first);
+                    std::swap(_offset, b._offset);
+                    std::swap(_stride, b._stride);
+                    std::swap(_count, b._count);
+                }
+                return *this;
+            }
+
+            /** destructor, destroys all objects */
+            ~factoryBlock() {
+                clear();
+            }
+
+            /** returns the i-th object */
+            B* operator [] (std::size_t i) const {
+                return reinterpret_cast<B*>(_first + i * _stride + _offset);
+            }
+
+            /** returns the number of objects */
+            std::size_t size() const {
+                return _count;
+            }
+
+            /** checks if the block holds no objects */
+            bool empty() const {
+                return _count == 0;
+            }
+
+            /** returns the distance between two neighbouring objects in bytes */
+            std::size_t stride() const {
+                return _stride;
+            }
+
+            /** destroys all objects and frees the block */
+            void clear() {
+                while (_count > 0) {
+                    --_count;
+                    _creator->destruct((*this)[_count]);
+                }
+
+                ::operator delete(_memory);
+                _memory = nullptr;
+                _first = nullptr;
+            }
+        private:
+            /** creator of the objects */
+            const factoryCreator<B>* _creator;
+            /** allocation holding the objects */
+            void* _memory;
+            /** storage of the first object */
+            char* _first;
+            /** offset of the base class subobject within the storage of an object */
+            std::ptrdiff_t _offset;
+            /** storage size of an object rounded up to its alignment */
+            std::size_t _stride;
+            /** number of objects constructed */
+            std::size_t _count;
+
+            /** noncopyable */
+            factoryBlock(const factoryBlock&) = delete;
+    };
+
     /** factory base class */
     class factoryBase {
         private:
             /** non-copyable */
             factoryBase(const factoryBase&);
+            /** fingerprint of the base class of the factory */
+            std::uint64_t _fingerprint;
         public:
             /** constructor */
-            factoryBase() {}
+            explicit factoryBase(std::uint64_t fingerprint) : _fingerprint(fingerprint) {}
             /** destructor */
             virtual ~factoryBase() {}
-            /** returns own type name */
+            /** returns own type name, for diagnostics only */
             virtual const char* typeName() const = 0;
+            /** returns the fingerprint of the base class, see fingerprint_of */
+            std::uint64_t fingerprint() const {
+                return _fingerprint;
+            }
     };
 
     /** factory creating objects from base class by identifier */
@@ -169,14 +586,38 @@ namespace modulepp {
                     inline const factoryCreator<C>* operator -> () const {
                         return _it->second;
                     }
+
+                    /** returns the identifier the current creator is registered under */
+                    inline const T& id() const {
+                        return _it->first;
+                    }
             };
 
-            /** destructor */
-            ~factory() = default;
+            /** constructor */
+            factory() : factoryBase(fingerprint_of<C>()) {}
+
+            /** destructor, frees all creators */
+            ~factory() {
+                for (auto &it : _factoryMap) {
+                    delete it.second;
+                }
+            }
 
             /** returns iterator to factory object or end if object cannot be found. */
-            Iterator find(const std::string& className) const {
-                return Iterator(_factoryMap.find(className));
+            Iterator find(string_ref className) const {
+                auto it = _index.find(className);
+                if (it == _index.end()) {
+                    return end();
+                } else {
+                    // the key is an owned string, no allocation takes place
+                    return Iterator(_factoryMap.find(it->second->first));
+                }
+            }
+
+            /** returns creator for the given id or nullptr if it cannot be found. */
+            const factoryCreator<C>* get(string_ref className) const {
+                auto it = _index.find(className);
+                return (it == _index.end()) ? nullptr : it->second->second;
             }
 
             /** returns iterator to the beginning of the map. */
@@ -191,18 +632,44 @@ namespace modulepp {
 
             /** insert a new object and its creator. */
             void insert(T id, factoryCreator<C>* c) {
-                this->_factoryMap[id] = c;
+                auto it = this->_factoryMap.find(id);
+                if (it == this->_factoryMap.end()) {
+                    it = this->_factoryMap.insert(std::make_pair(id, c)).first;
+                    this->_index[string_ref(it->first)] = &*it;
+                } else {
+                    delete it->second;
+                    it->second = c;
+                }
             }
 
             /** creates an object by id */
-            C* create(T id) {
-                if (this->_factoryMap.find(id) != this->_factoryMap.end()) {
-                    return _factoryMap[id]->create();
+            C* create(string_ref id) const {
+                const factoryCreator<C>* c = get(id);
+                if (c != nullptr) {
+                    return c->create();
                 } else {
                     throw factoryException();
                 }
             }
 
+            /**
+             * creates n objects by id in one contiguous block, writing a pointer to each of them to out
+             *
+             * The objects are owned by the returned block, see factoryBlock.
+             */
+            template <typename OutputIt>
+            factoryBlock<C> create_many(string_ref id, std::size_t n, OutputIt out) const {
+                const factoryCreator<C>* c = get(id);
+                if (c == nullptr)
+                    throw factoryException();
+
+                factoryBlock<C> block(c, n);
+                for (std::size_t i = 0; i < n; ++i, ++out) {
+                    *out = block[i];
+                }
+                return block;
+            }
+
             /** returns factory size */
             std::size_t size() const {
                 return _factoryMap.size();
@@ -215,11 +682,17 @@ namespace modulepp {
 
             /** returns own type name */
             const char* typeName() const {
-                return typeid(*this).name();
+                #ifdef MODULEPP_RTTI
+                    return typeid(*this).name();
+                #else
+                    return "modulepp::factory";
+                #endif
             }
         private:
             /** map holding identifiers and object creators. */
             FactoryMap _factoryMap;
+            /** lookup index referencing the identifiers owned by _factoryMap. */
+            std::unordered_map<string_ref, const typename FactoryMap::value_type*, string_ref_hash> _index;
     };
 }
 
@@ -0,0 +1,147 @@
+/**
+ * @file module_fingerprint.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_FINGERPRINT_HPP_
+#define _MODULEPP_MODULE_FINGERPRINT_HPP_
+
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "module_string.hpp"
+
+#if defined(_MSC_VER)
+    #define MODULEPP_SIGNATURE __FUNCSIG__
+#else
+    #define MODULEPP_SIGNATURE __PRETTY_FUNCTION__
+#endif
+
+/**
+ * Declares an ABI-stable fingerprint for a base class, to be placed in the header declaring the base.
+ *
+ * The fingerprint is a compile-time hash of the spelled class name and the given version, bump the
+ * version whenever the layout or the virtual functions of the base change. Has to be used at global
+ * scope with the fully qualified class name.
+ *
+ * MODULEPP_DECLARE_BASE(MyBaseClass, 1)
+ **/
+#define MODULEPP_DECLARE_BASE(base, version)                                                          \
+namespace modulepp {                                                                                  \
+    template <>                                                                                       \
+    struct base_traits<base> {                                                                        \
+        static const bool declared = true;                                                            \
+        static constexpr std::uint64_t fingerprint() {                                                \
+            return hash_name(#base, sizeof(#base) - 1, HASH_BASIS ^ FACTORY_ABI_VERSION ^ (version)); \
+        }                                                                                             \
+    };                                                                                                \
+}
+
+namespace modulepp {
+    /** Version of the factory layout shared between loader and modules, part of every fingerprint */
+    static const std::uint64_t FACTORY_ABI_VERSION = 4;
+
+    /** Traits of a base class, specialized by MODULEPP_DECLARE_BASE */
+    template <typename B>
+    struct base_traits {
+        static const bool declared = false;
+    };
+
+    /**
+     * Hashes the name of the type parameter B out of a function signature.
+     *
+     * Only compilers spelling the type the same way agree on the result, gcc and clang do.
+     */
+    inline std::uint64_t signature_fingerprint(const char* signature) {
+        const char* begin = std::strstr(signature, "B = ");
+        if (begin != nullptr) {
+            begin += 4;
+        } else if ((begin = std::strstr(signature, "fingerprint_impl<")) != nullptr) {
+            begin += 17;
+            if (std::strncmp(begin, "class ", 6) == 0 || std::strncmp(begin, "union ", 6) == 0)
+                begin += 6;
+            else if (std::strncmp(begin, "struct ", 7) == 0)
+                begin += 7;
+        } else {
+            return hash_bytes(signature, std::strlen(signature), HASH_BASIS ^ FACTORY_ABI_VERSION);
+        }
+
+        // the type ends at the first separator outside of template arguments
+        const char* end = begin;
+        for (int depth = 0; *end != '\0'; ++end) {
+            if (*end == '<' || *end == '(') {
+                ++depth;
+            } else if (*end == '>' || *end == ')') {
+                --depth;
+            } else if (depth == 0 && (*end == ';' || *end == ']' || *end == ',')) {
+                break;
+            }
+        }
+
+        return hash_bytes(begin, end - begin, HASH_BASIS ^ FACTORY_ABI_VERSION);
+    }
+
+    /** Computes the fingerprint of B, compile-time for declared bases */
+    template <typename B, bool = base_traits<B>::declared>
+    struct fingerprint_impl {
+        static constexpr std::uint64_t value() {
+            return base_traits<B>::fingerprint();
+        }
+    };
+
+    /** Fallback for undeclared bases, hashes the compiler's spelling of the type once */
+    template <typename B>
+    struct fingerprint_impl<B, false> {
+        static std::uint64_t value() {
+            static const std::uint64_t fingerprint = signature_fingerprint(MODULEPP_SIGNATURE);
+            return fingerprint;
+        }
+    };
+
+    /**
+     * Returns the fingerprint identifying the base class B across library boundaries.
+     *
+     * Doesn't need RTTI. Bases declared with MODULEPP_DECLARE_BASE get a constant independent of the
+     * compiler, others fall back to hashing the compiler's spelling of the type name.
+     */
+    template <typename B>
+    constexpr std::uint64_t fingerprint_of() {
+        return fingerprint_impl<B>::value();
+    }
+
+    /** Returns the fingerprint of a constructor argument list, references and qualifiers included. */
+    template <typename... Args>
+    inline std::uint64_t args_fingerprint() {
+        const std::uint64_t parts[] = { 0, fingerprint_of<Args>()... };
+
+        std::uint64_t h = HASH_BASIS ^ sizeof...(Args);
+        for (std::uint64_t part : parts) {
+            h = (h ^ part) * HASH_PRIME;
+        }
+        return h;
+    }
+}
+
+#endif /* _MODULEPP_MODULE_FINGERPRINT_HPP_ */
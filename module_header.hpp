@@ -28,19 +28,50 @@
 #define _MODULEPP_MODULE_HEADER_HPP_
 
 #include <string>
-#include <typeinfo>
+#include <cstdint>
 #include <exception>
 
 #include "module_factory.hpp"
+#include "module_manifest.hpp"
 
 /**
  * Short usage example:
  *
+ * MODULEPP_DECLARE_BASE(MyBaseClass, 1) // optional, next to the base class
+ *
  * BEGIN_MODULE_FACTORY(MyBaseClass)
  *     EXPORT_CLASS(MyFirstClass)
  *     EXPORT_CLASS(MySecondClass)
+ *     EXPORT_CLASS_POOLED(MyShortLivedClass)
+ *     EXPORT_CLASS_ARGS(MyConfiguredClass, const MyConfig&, int)
+ *     EXPORT_CLASS_INTERFACES(MyExtendedClass, MyExtension, MyOtherExtension)
  *     ....
  * END_MODULE_FACTORY
+ *
+ * Modules exporting classes for several base classes list them in one factory, the loader of each base
+ * class only sees the classes exported for it:
+ *
+ * BEGIN_MODULE_FACTORIES
+ *     BEGIN_FACTORY_BASE(MyBaseClass)
+ *         EXPORT_CLASS(MyFirstClass)
+ *     END_FACTORY_BASE
+ *     BEGIN_FACTORY_BASE(MyOtherBaseClass)
+ *         EXPORT_CLASS(MyOtherClass)
+ *     END_FACTORY_BASE
+ * END_MODULE_FACTORIES
+ *
+ * Alternatively, a static manifest is built into the read-only data of the module and loaded
+ * without registering classes at runtime. It needs a declared base class and the classes sorted
+ * by name:
+ *
+ * MODULEPP_DECLARE_BASE(MyBaseClass, 1)
+ *
+ * BEGIN_MODULE_MANIFEST(MyBaseClass)
+ *     EXPORT_MANIFEST_CLASS(MyFirstClass)
+ *     EXPORT_MANIFEST_CLASS_POOLED(MyShortLivedClass)
+ *     EXPORT_MANIFEST_CLASS_INTERFACES(MyThirdClass, MyExtension)
+ *     ....
+ * END_MODULE_MANIFEST
  **/
 
 namespace modulepp {
@@ -53,10 +84,21 @@ namespace modulepp {
     };
 }
 
+/** Marks symbols looked up by the loader as exported, also when building with hidden visibility. */
+#if defined(_WIN32)
+    #define MODULEPP_EXPORT __declspec(dllexport)
+#elif defined(__GNUC__)
+    #define MODULEPP_EXPORT __attribute__((visibility("default")))
+#else
+    #define MODULEPP_EXPORT
+#endif
+
 extern "C" {
-    bool buildFactory(modulepp::factoryBase *modFactory);
-    void initializeLibrary();
-    void uninitializeLibrary();
+    MODULEPP_EXPORT bool buildFactory(modulepp::factoryBase *modFactory);
+    MODULEPP_EXPORT void initializeLibrary();
+    MODULEPP_EXPORT void uninitializeLibrary();
+    MODULEPP_EXPORT extern const modulepp::manifestHeader moduleManifest;
+    MODULEPP_EXPORT extern const modulepp::manifestEntry moduleManifestEntries[];
 }
 
 #define BEGIN_MODULE_FACTORY(base)                                       \
@@ -64,11 +106,10 @@ bool buildFactory(modulepp::factoryBase *modFactoryBase) {               \
     typedef base modBase;                                                \
     typedef modulepp::factory<std::string, modBase> _factory;            \
                                                                          \
-    std::string requiredType(typeid(_factory).name());                   \
-    std::string actualType(modFactoryBase->typeName());                  \
+    const std::uint64_t required = modulepp::fingerprint_of<modBase>();  \
                                                                          \
-    if (requiredType == actualType) {                                    \
-        _factory *modFactory = dynamic_cast<_factory*>(modFactoryBase);
+    if (modFactoryBase->fingerprint() == required) {                     \
+        _factory *modFactory = static_cast<_factory*>(modFactoryBase);
 
 #define EXPORT_CLASS(modClass) \
         modFactory->insert(#modClass, new modulepp::factoryCreatorBasic<modBase, modClass>());
@@ -76,6 +117,15 @@ bool buildFactory(modulepp::factoryBase *modFactoryBase) {               \
 #define EXPORT_CLASS_ADVANCE(modClass) \
         modFactory->insert(#modClass, new modulepp::factoryCreatorAdvance<modBase, modClass>());
 
+#define EXPORT_CLASS_POOLED(modClass) \
+        modFactory->insert(#modClass, new modulepp::factoryCreatorPooled<modBase, modClass>());
+
+#define EXPORT_CLASS_ARGS(modClass, ...) \
+        modFactory->insert(#modClass, new modulepp::factoryCreatorArgsTyped<modBase, modClass, __VA_ARGS__>());
+
+#define EXPORT_CLASS_INTERFACES(modClass, ...) \
+        modFactory->insert(#modClass, new modulepp::factoryCreatorInterfaces<modBase, modClass, __VA_ARGS__>());
+
 #define END_MODULE_FACTORY                                           \
         return true;                                                 \
     } else {                                                         \
@@ -84,4 +134,81 @@ bool buildFactory(modulepp::factoryBase *modFactoryBase) {               \
     }                                                                \
 }
 
+#define BEGIN_MODULE_FACTORIES                                           \
+bool buildFactory(modulepp::factoryBase *modFactoryBase) {               \
+    const std::uint64_t modFingerprint = modFactoryBase->fingerprint();
+
+#define BEGIN_FACTORY_BASE(base)                                         \
+    {                                                                    \
+        typedef base modBase;                                            \
+        typedef modulepp::factory<std::string, modBase> _factory;        \
+                                                                         \
+        if (modFingerprint == modulepp::fingerprint_of<modBase>()) {     \
+            _factory *modFactory = static_cast<_factory*>(modFactoryBase);
+
+#define END_FACTORY_BASE                                                 \
+            return true;                                                 \
+        }                                                                \
+    }
+
+#define END_MODULE_FACTORIES                                             \
+    throw modulepp::typeMismatchException();                             \
+    return false;                                                        \
+}
+
+#define BEGIN_MODULE_MANIFEST(base)                                                          \
+namespace {                                                                                  \
+    typedef base modManifestBase;                                                            \
+                                                                                             \
+    static_assert(modulepp::base_traits<modManifestBase>::declared,                          \
+        "The base class of a manifest has to be declared with MODULEPP_DECLARE_BASE");       \
+                                                                                             \
+    template <typename Creator>                                                              \
+    struct modManifestCreator {                                                              \
+        static const Creator instance;                                                       \
+    };                                                                                       \
+                                                                                             \
+    template <typename Creator>                                                              \
+    const Creator modManifestCreator<Creator>::instance;                                     \
+}                                                                                            \
+                                                                                             \
+constexpr modulepp::manifestEntry moduleManifestEntries[] = {
+
+#define EXPORT_MANIFEST_ENTRY(modClass, modCreator)                                          \
+    { #modClass, modulepp::hash_name(#modClass, sizeof(#modClass) - 1),                     \
+      sizeof(modClass), alignof(modClass),                                                   \
+      static_cast<const modulepp::factoryCreator<modManifestBase>*>(                         \
+          &modManifestCreator<modulepp::modCreator<modManifestBase, modClass> >::instance),  \
+      &modulepp::manifestCreate<modManifestBase, modClass>,                                  \
+      &modulepp::manifestDestroy<modManifestBase, modClass> },
+
+#define EXPORT_MANIFEST_CLASS(modClass) \
+    EXPORT_MANIFEST_ENTRY(modClass, factoryCreatorBasic)
+
+#define EXPORT_MANIFEST_CLASS_POOLED(modClass) \
+    EXPORT_MANIFEST_ENTRY(modClass, factoryCreatorPooled)
+
+#define EXPORT_MANIFEST_CLASS_INTERFACES(modClass, ...)                                      \
+    { #modClass, modulepp::hash_name(#modClass, sizeof(#modClass) - 1),                     \
+      sizeof(modClass), alignof(modClass),                                                   \
+      static_cast<const modulepp::factoryCreator<modManifestBase>*>(                         \
+          &modManifestCreator<modulepp::factoryCreatorInterfaces<modManifestBase, modClass,  \
+              __VA_ARGS__> >::instance),                                                     \
+      &modulepp::manifestCreate<modManifestBase, modClass>,                                  \
+      &modulepp::manifestDestroy<modManifestBase, modClass> },
+
+#define END_MODULE_MANIFEST                                                                  \
+};                                                                                           \
+                                                                                             \
+static_assert(modulepp::manifest_sorted(moduleManifestEntries,                               \
+    sizeof(moduleManifestEntries) / sizeof(moduleManifestEntries[0])),                       \
+    "Manifest classes have to be listed sorted by name, without duplicates");                \
+                                                                                             \
+constexpr modulepp::manifestHeader moduleManifest = {                                        \
+    modulepp::MANIFEST_MAGIC, modulepp::FACTORY_ABI_VERSION,                                 \
+    modulepp::fingerprint_of<modManifestBase>(),                                             \
+    sizeof(moduleManifestEntries) / sizeof(moduleManifestEntries[0]),                        \
+    sizeof(modulepp::manifestEntry)                                                          \
+};
+
 #endif /* _MODULEPP_MODULE_HEADER_HPP_ */
\ No newline at end of file
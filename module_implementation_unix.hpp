@@ -29,19 +29,37 @@
 #if defined(__LINUX__) || defined(__APPLE__) || defined(hpux) || defined(_hpux) || defined(__GNUC__)
 
 #include <mutex>
+#include <string>
+#include <vector>
 #include <cstddef>
+#include <algorithm>
+#include <cstring>
 #include <dlfcn.h>
+#include <dirent.h>
+
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+    #include <link.h>
+    #define MODULEPP_MAPPED_SIZE_PHDR
+#endif
 
 #include "module_library_exceptions.hpp"
+#include "module_shared_mutex.hpp"
 
 namespace modulepp {
     /** Shared library implementation for unix systems */
     class shared_library_unix {
         public:
-            /** Library loading flags. */
+            /** Library loading flags, modes the platform lacks are ignored. */
             enum Flags {
-                SHLIB_GLOBAL_IMPL = 1,
-                SHLIB_LOCAL_IMPL  = 2
+                SHLIB_GLOBAL_IMPL              = 1,
+                SHLIB_LOCAL_IMPL               = 2,
+                SHLIB_NOW_IMPL                 = 4,
+                SHLIB_NODELETE_IMPL            = 8,
+                SHLIB_DEEPBIND_IMPL            = 16,
+                SHLIB_NOLOAD_IMPL              = 32,
+                SHLIB_ALTERED_SEARCH_PATH_IMPL = 64,
+                SHLIB_NO_REFERENCES_IMPL       = 128,
+                SHLIB_EXACT_PATH_IMPL          = 256
             };
 
             /** Constructor */
@@ -53,22 +71,41 @@ namespace modulepp {
             }
 
             /** Load library from given path */
-            void load(const std::string& path, int flags = 0) {
-                std::lock_guard<std::mutex> lock(mutex);
+            void load(const char* path, int flags = 0) {
+                std::lock_guard<shared_mutex> lock(mutex);
 
                 if (handle != nullptr) {
                     throw libraryOverwriteException();
                 }
 
-                this->path = path+this->suffix();
+                this->path.assign(path);
+                if (!(flags & SHLIB_EXACT_PATH_IMPL)) {
+                    this->path.append(suffix());
+                }
 
-                int realFlags = RTLD_LAZY;
+                int realFlags = (flags & SHLIB_NOW_IMPL) ? RTLD_NOW : RTLD_LAZY;
                 if (flags & SHLIB_LOCAL_IMPL) {
                     realFlags |= RTLD_LOCAL;
                 } else {
                     realFlags |= RTLD_GLOBAL;
                 }
 
+                #ifdef RTLD_NODELETE
+                if (flags & SHLIB_NODELETE_IMPL) {
+                    realFlags |= RTLD_NODELETE;
+                }
+                #endif
+                #ifdef RTLD_DEEPBIND
+                if (flags & SHLIB_DEEPBIND_IMPL) {
+                    realFlags |= RTLD_DEEPBIND;
+                }
+                #endif
+                #ifdef RTLD_NOLOAD
+                if (flags & SHLIB_NOLOAD_IMPL) {
+                    realFlags |= RTLD_NOLOAD;
+                }
+                #endif
+
                 handle = dlopen(this->path.c_str(), realFlags);
                 if (!handle) {
                     handle = nullptr;
@@ -76,9 +113,14 @@ namespace modulepp {
                 }
             }
 
+            /** Load library from given path */
+            void load(const std::string& path, int flags = 0) {
+                load(path.c_str(), flags);
+            }
+
             /** Unload library freeing all ressources */
             void unload() {
-                std::lock_guard<std::mutex> lock(mutex);
+                std::lock_guard<shared_mutex> lock(mutex);
 
                 if (handle != nullptr) {
                     dlclose(handle);
@@ -92,12 +134,12 @@ namespace modulepp {
             }
 
             /** Return symbol to looked up pointer or NULL if non is found. */
-            void* findSymbol(const std::string& name) {
-                std::lock_guard<std::mutex> lock(mutex);
+            void* findSymbol(const char* name) {
+                shared_lock_guard lock(mutex);
 
                 void* result = nullptr;
                 if (handle != nullptr) {
-                    result = dlsym(handle, name.c_str());
+                    result = dlsym(handle, name);
                 } else {
                     throw libraryAccessException();
                 }
@@ -105,8 +147,50 @@ namespace modulepp {
                 return result;
             }
 
+            /** Return symbol to looked up pointer or NULL if non is found. */
+            void* findSymbol(const std::string& name) {
+                return findSymbol(name.c_str());
+            }
+
+            /** Returns the number of bytes mapped for the library, 0 if unknown */
+            std::size_t mappedSize() const {
+                shared_lock_guard lock(mutex);
+
+                std::size_t result = 0;
+                #ifdef MODULEPP_MAPPED_SIZE_PHDR
+                    struct link_map* map = nullptr;
+                    if (handle != nullptr && dlinfo(handle, RTLD_DI_LINKMAP, &map) == 0 && map != nullptr) {
+                        mappedQuery query = { map, 0 };
+                        dl_iterate_phdr(&mappedSegments, &query);
+                        result = query.size;
+                    }
+                #endif
+                return result;
+            }
+
+            /** Returns paths of all libraries in a directory, without suffix and sorted. */
+            static std::vector<std::string> listLibraries(const std::string& directory) {
+                DIR* dir = opendir(directory.c_str());
+                if (dir == nullptr) {
+                    throw libraryDirectoryException();
+                }
+
+                const std::string ext = suffix();
+                std::vector<std::string> result;
+                for (dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+                    std::string name(entry->d_name);
+                    if (name.size() > ext.size() && name.compare(name.size() - ext.size(), ext.size(), ext) == 0) {
+                        result.push_back(directory + "/" + name.substr(0, name.size() - ext.size()));
+                    }
+                }
+                closedir(dir);
+
+                std::sort(result.begin(), result.end());
+                return result;
+            }
+
             /** Returns library suffix. */
-            const std::string suffix() {
+            static constexpr const char* suffix() {
                 #if defined(__APPLE__)
                     return ".dylib";
                 #elif defined(hpux) || defined(_hpux)
@@ -120,9 +204,31 @@ namespace modulepp {
             std::string path;
             /** Pointer to the shared library. */
             void* handle;
-            /** Mutex to synchonize library access. */
-            mutable std::mutex mutex;
+            /** Mutex to synchonize library access, symbol lookups only take it shared. */
+            mutable shared_mutex mutex;
         private:
+            #ifdef MODULEPP_MAPPED_SIZE_PHDR
+            /** Object looked up by mappedSegments and the size of its segments */
+            struct mappedQuery {
+                const struct link_map* map;
+                std::size_t size;
+            };
+
+            /** dl_iterate_phdr callback summing up the loadable segments of the queried object */
+            static int mappedSegments(struct dl_phdr_info* info, std::size_t, void* data) {
+                mappedQuery* query = static_cast<mappedQuery*>(data);
+                if (info->dlpi_addr != query->map->l_addr || info->dlpi_name == nullptr || query->map->l_name == nullptr ||
+                    std::strcmp(info->dlpi_name, query->map->l_name) != 0)
+                    return 0;
+
+                for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+                    if (info->dlpi_phdr[i].p_type == PT_LOAD)
+                        query->size += info->dlpi_phdr[i].p_memsz;
+                }
+                return 1;
+            }
+            #endif
+
             /** Prevent copying */
             shared_library_unix(const shared_library_unix&) = delete;
     };
@@ -29,14 +29,36 @@
 #ifdef _WIN32
 
 #include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
 #include <Windows.h>
 
 #include "module_library_exceptions.hpp"
+#include "module_shared_mutex.hpp"
 
 namespace modulepp {
     /** Shared library implementation for windows systems */
     class shared_library_win32 {
         public:
+            /**
+             * Library loading flags, modes the platform lacks are ignored.
+             *
+             * Imports are always bound at load time on windows, so neither symbol binding
+             * nor symbol scope is configurable.
+             */
+            enum Flags {
+                SHLIB_GLOBAL_IMPL              = 1,
+                SHLIB_LOCAL_IMPL               = 2,
+                SHLIB_NOW_IMPL                 = 4,
+                SHLIB_NODELETE_IMPL            = 8,
+                SHLIB_DEEPBIND_IMPL            = 16,
+                SHLIB_NOLOAD_IMPL              = 32,
+                SHLIB_ALTERED_SEARCH_PATH_IMPL = 64,
+                SHLIB_NO_REFERENCES_IMPL       = 128,
+                SHLIB_EXACT_PATH_IMPL          = 256
+            };
+
             /** Constructor */
             shared_library_win32() : path(""), handle(nullptr) {}
 
@@ -46,25 +68,55 @@ namespace modulepp {
             }
 
             /** Load library from given path */
-            void load(const std::string& path, int flags = 0) {
-                std::lock_guard<std::mutex> lock(mutex);
+            void load(const char* path, int flags = 0) {
+                std::lock_guard<shared_mutex> lock(mutex);
 
                 if (handle != nullptr) {
                     throw libraryOverwriteException();
                 }
 
-                this->path = path+this->suffix();
+                this->path.assign(path);
+                if (!(flags & SHLIB_EXACT_PATH_IMPL)) {
+                    this->path.append(suffix());
+                }
 
-                handle = LoadLibraryExA(this->path.c_str(), 0, 0);
-                if (!handle) {
-                    handle = nullptr;
-                    throw libraryLoadException();
+                if (flags & SHLIB_NOLOAD_IMPL) {
+                    // takes a reference like LoadLibraryExA, but only if the module is already mapped
+                    HMODULE module = nullptr;
+                    if (!GetModuleHandleExA(0, this->path.c_str(), &module)) {
+                        throw libraryLoadException();
+                    }
+                    handle = module;
+                } else {
+                    DWORD realFlags = 0;
+                    if (flags & SHLIB_ALTERED_SEARCH_PATH_IMPL) {
+                        realFlags |= LOAD_WITH_ALTERED_SEARCH_PATH;
+                    }
+                    if (flags & SHLIB_NO_REFERENCES_IMPL) {
+                        realFlags |= DONT_RESOLVE_DLL_REFERENCES;
+                    }
+
+                    handle = LoadLibraryExA(this->path.c_str(), 0, realFlags);
+                    if (!handle) {
+                        handle = nullptr;
+                        throw libraryLoadException();
+                    }
+                }
+
+                if (flags & SHLIB_NODELETE_IMPL) {
+                    HMODULE pinned = nullptr;
+                    GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_PIN, this->path.c_str(), &pinned);
                 }
             }
 
+            /** Load library from given path */
+            void load(const std::string& path, int flags = 0) {
+                load(path.c_str(), flags);
+            }
+
             /** Unload library freeing all ressources */
             void unload() {
-                std::lock_guard<std::mutex> lock(mutex);
+                std::lock_guard<shared_mutex> lock(mutex);
 
                 if (handle != nullptr) {
                     FreeLibrary((HMODULE) handle);
@@ -78,12 +130,12 @@ namespace modulepp {
             }
 
             /** Return symbol to looked up pointer or NULL if non is found. */
-            void* findSymbol(const std::string& name) {
-                std::lock_guard<std::mutex> lock(mutex);
+            void* findSymbol(const char* name) {
+                shared_lock_guard lock(mutex);
 
                 void* result = nullptr;
                 if (handle != nullptr) {
-                    result = (void*) GetProcAddress((HMODULE) handle, name.c_str());
+                    result = (void*) GetProcAddress((HMODULE) handle, name);
                 } else {
                     throw libraryAccessException();
                 }
@@ -91,8 +143,55 @@ namespace modulepp {
                 return result;
             }
 
+            /** Return symbol to looked up pointer or NULL if non is found. */
+            void* findSymbol(const std::string& name) {
+                return findSymbol(name.c_str());
+            }
+
+            /** Returns the number of bytes mapped for the library, 0 if unknown */
+            std::size_t mappedSize() const {
+                shared_lock_guard lock(mutex);
+
+                if (handle == nullptr)
+                    return 0;
+
+                // the image headers are mapped at the module base
+                const unsigned char* base = static_cast<const unsigned char*>(handle);
+                const IMAGE_DOS_HEADER* dos = reinterpret_cast<const IMAGE_DOS_HEADER*>(base);
+                if (dos->e_magic != IMAGE_DOS_SIGNATURE)
+                    return 0;
+
+                const IMAGE_NT_HEADERS* nt = reinterpret_cast<const IMAGE_NT_HEADERS*>(base + dos->e_lfanew);
+                return (nt->Signature == IMAGE_NT_SIGNATURE) ? nt->OptionalHeader.SizeOfImage : 0;
+            }
+
+            /** Returns paths of all libraries in a directory, without suffix and sorted. */
+            static std::vector<std::string> listLibraries(const std::string& directory) {
+                WIN32_FIND_DATAA data;
+                HANDLE find = FindFirstFileA((directory + "\\*" + suffix()).c_str(), &data);
+                if (find == INVALID_HANDLE_VALUE) {
+                    if (GetLastError() == ERROR_FILE_NOT_FOUND) {
+                        return std::vector<std::string>();
+                    }
+                    throw libraryDirectoryException();
+                }
+
+                const std::string ext = suffix();
+                std::vector<std::string> result;
+                do {
+                    std::string name(data.cFileName);
+                    if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && name.size() > ext.size()) {
+                        result.push_back(directory + "\\" + name.substr(0, name.size() - ext.size()));
+                    }
+                } while (FindNextFileA(find, &data));
+                FindClose(find);
+
+                std::sort(result.begin(), result.end());
+                return result;
+            }
+
             /** Returns library suffix. */
-            const std::string suffix() {
+            static constexpr const char* suffix() {
                 return ".dll";
             }
         protected:
@@ -100,11 +199,11 @@ namespace modulepp {
             std::string path;
             /** Pointer to the shared library. */
             void* handle;
-            /** Mutex to synchonize library access. */
-            mutable std::mutex mutex;
+            /** Mutex to synchonize library access, symbol lookups only take it shared. */
+            mutable shared_mutex mutex;
         private:
             /** Prevent copying */
-            shared_library_win32(const shared_library_unix&) = delete;
+            shared_library_win32(const shared_library_win32&) = delete;
     };
 };
 
@@ -28,11 +28,36 @@
 #define	_MODULEPP_MODULE_LIBRARY_HPP_
 
 #include <string>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
 #include <unordered_map>
+#include <memory>
+#include <atomic>
 #include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <deque>
+#include <forward_list>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <type_traits>
 
 #include "module_library_exceptions.hpp"
+#include "module_string.hpp"
 #include "module_factory.hpp"
+#include "module_manifest.hpp"
+#include "module_probe.hpp"
+#include "module_bundle.hpp"
+#include "module_observer.hpp"
+#include "module_shared_mutex.hpp"
+#include "module_stats.hpp"
+#include "module_epoch.hpp"
 
 #if defined(__LINUX__) || defined(__APPLE__) || defined(hpux) || defined(_hpux) || defined(__GNUC__)
     #include "module_implementation_unix.hpp"
@@ -44,14 +69,70 @@
     static_assert( false, "No viable shared library implementation found." );
 #endif
 
+/** Number of creates of the same library a thread records with a single clock read while eviction is enabled. */
+#ifndef MODULEPP_TOUCH_SAMPLE
+    #define MODULEPP_TOUCH_SAMPLE 64
+#endif
+
 namespace modulepp {
-    /** Shared library class, inherits from its implementation based on the current operating system. */
+    /**
+     * Shared library class, inherits from its implementation based on the current operating system.
+     *
+     * Symbols are looked up once and cached until the library is unloaded, lookups of cached
+     * symbols don't allocate.
+     */
     template <typename impl = SHARED_LIBRARY_IMPLEMENTATION>
     class shared_library_base : public impl {
         public:
+            using impl::findSymbol;
+
+            /** Load library from given path */
+            void load(const char* path, int flags = 0) {
+                clearSymbols();
+                impl::load(path, flags);
+            }
+
+            /** Load library from given path */
+            void load(const std::string& path, int flags = 0) {
+                load(path.c_str(), flags);
+            }
+
+            /** Unload library freeing all ressources */
+            void unload() {
+                clearSymbols();
+                impl::unload();
+            }
+
             /** Returns true if specified symbol exists. */
-            virtual bool hasSymbol(const std::string& name) {
-                return (this->findSymbol(name) != nullptr);
+            virtual bool hasSymbol(string_ref name) {
+                return (this->cachedSymbol(name) != nullptr);
+            }
+
+            /** Returns the symbol from the cache, looking it up on first use. Returns nullptr if non is found. */
+            void* cachedSymbol(string_ref name) {
+                {
+                    shared_lock_guard lock(symbolMutex);
+                    auto it = symbols.find(name);
+                    if (it != symbols.end())
+                        return it->second;
+                }
+
+                std::lock_guard<shared_mutex> lock(symbolMutex);
+                auto it = symbols.find(name);
+                if (it != symbols.end())
+                    return it->second;
+
+                // keep an owned copy of the name, the cache references it
+                symbolNames.push_front(name.str());
+                void* result = impl::findSymbol(symbolNames.front().c_str());
+                symbols[string_ref(symbolNames.front())] = result;
+                return result;
+            }
+
+            /** Returns the cached symbol converted to the given function pointer type. */
+            template <typename F>
+            F findSymbol(string_ref name) {
+                return reinterpret_cast<F>(this->cachedSymbol(name));
             }
 
             /** Returns path to loaded library. */
@@ -65,6 +146,20 @@ namespace modulepp {
             /** Virtual destructor */
             virtual ~shared_library_base() {}
         private:
+            /** Cached symbol addresses, keys reference symbolNames */
+            std::unordered_map<string_ref, void*, string_ref_hash> symbols;
+            /** Names of cached symbols */
+            std::forward_list<std::string> symbolNames;
+            /** Mutex protecting the cache, hits only take it shared */
+            shared_mutex symbolMutex;
+
+            /** Empties the cache */
+            void clearSymbols() {
+                std::lock_guard<shared_mutex> lock(symbolMutex);
+                symbols.clear();
+                symbolNames.clear();
+            }
+
             /** Non-Copyable */
             shared_library_base(const shared_library_base&) = delete;
     };
@@ -72,57 +167,628 @@ namespace modulepp {
     /** Typedef for the operating-system specific shared_library implementation. */
     typedef shared_library_base<> shared_library;
 
-    /** Loads exported C++ classes extending a common base class from a shared library. */
-    template <class B>
+    /**
+     * Options controlling how the operating system maps a library.
+     *
+     * Modes a platform does not support are ignored, see shared_library::Flags.
+     */
+    struct load_options {
+        /** Bind all symbols while loading instead of on first call (RTLD_NOW) */
+        bool now;
+        /** Keep the symbols of the library out of the global namespace (RTLD_LOCAL) */
+        bool local;
+        /** Never unmap the library, even after the last reference is gone (RTLD_NODELETE, pinned module) */
+        bool nodelete;
+        /** Prefer symbols of the library over global ones with the same name (RTLD_DEEPBIND) */
+        bool deepbind;
+        /** Only succeed if the library is already mapped into the process (RTLD_NOLOAD, GetModuleHandleEx) */
+        bool noload;
+        /** Search dependencies next to the library first (LOAD_WITH_ALTERED_SEARCH_PATH) */
+        bool alteredSearchPath;
+        /** Map the library without loading its dependencies or running DllMain (DONT_RESOLVE_DLL_REFERENCES) */
+        bool noReferences;
+
+        /** Constructor, defaults to lazy binding in the global namespace */
+        load_options() : now(false), local(false), nodelete(false), deepbind(false), noload(false),
+            alteredSearchPath(false), noReferences(false) {}
+
+        /** Returns the flags passed to shared_library::load */
+        int flags() const {
+            int result = local ? shared_library::SHLIB_LOCAL_IMPL : shared_library::SHLIB_GLOBAL_IMPL;
+            if (now)
+                result |= shared_library::SHLIB_NOW_IMPL;
+            if (nodelete)
+                result |= shared_library::SHLIB_NODELETE_IMPL;
+            if (deepbind)
+                result |= shared_library::SHLIB_DEEPBIND_IMPL;
+            if (noload)
+                result |= shared_library::SHLIB_NOLOAD_IMPL;
+            if (alteredSearchPath)
+                result |= shared_library::SHLIB_ALTERED_SEARCH_PATH_IMPL;
+            if (noReferences)
+                result |= shared_library::SHLIB_NO_REFERENCES_IMPL;
+            return result;
+        }
+    };
+
+    /**
+     * Libraries shared between class loaders, each path is opened and initialized only once.
+     *
+     * Loaders constructed with the same registry share the handle, the symbol cache and the lifecycle of a
+     * library, and the factory of each base class is built only once per library. Modules exporting classes
+     * for several bases use BEGIN_MODULE_FACTORIES. A library is closed once no loader uses it anymore.
+     */
+    class library_registry {
+        public:
+            /** Definition for optional initialization and uninitialization functions. */
+            typedef void (*LifecycleFunc)();
+
+            /** A library opened by the registry along with the factories built from it. */
+            class module {
+                public:
+                    /** Opens the library from the given file */
+                    module(const std::string& file, int flags) : _flags(flags), _initialized(false), _uninitialize(nullptr) {
+                        _library.load(file, flags);
+                    }
+
+                    /** Destructor, uninitializes and frees all factories before closing the library */
+                    ~module() {
+                        if (_initialized && _uninitialize != nullptr)
+                            _uninitialize();
+
+                        _factories.clear();
+                        _library.unload();
+                    }
+
+                    /** Returns the library */
+                    shared_library& library() {
+                        return _library;
+                    }
+
+                    /** Returns the flags the library was opened with */
+                    int flags() const {
+                        return _flags;
+                    }
+
+                    /** Calls initialize unless the library was already initialized, uninitialize is called on destruction. Returns true if called. */
+                    bool initialize(LifecycleFunc initialize, LifecycleFunc uninitialize) {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        if (_initialized)
+                            return false;
+
+                        if (initialize != nullptr)
+                            initialize();
+
+                        _uninitialize = uninitialize;
+                        _initialized = true;
+                        return (initialize != nullptr);
+                    }
+
+                    /**
+                     * Returns the factory for base class B, building it with build on first use.
+                     *
+                     * Returns nullptr if the module refused to build it, exceptions thrown by build are passed on
+                     * and the build is tried again next time.
+                     */
+                    template <typename B>
+                    const factory<std::string, B>* build(bool (*build)(factory<std::string, B>*)) {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        auto it = _factories.find(fingerprint_of<B>());
+                        if (it != _factories.end())
+                            return static_cast<const factory<std::string, B>*>(it->second.get());
+
+                        std::unique_ptr<factory<std::string, B>> result(new factory<std::string, B>());
+                        if (!build(result.get()))
+                            result.reset();
+
+                        const factory<std::string, B>* built = result.get();
+                        _factories[fingerprint_of<B>()] = std::move(result);
+                        return built;
+                    }
+                private:
+                    /** The library */
+                    shared_library _library;
+                    /** Flags the library was opened with */
+                    int _flags;
+                    /** Mutex serializing initialization and builds */
+                    std::mutex _mutex;
+                    /** Whether initialize ran */
+                    bool _initialized;
+                    /** Optional uninitialization function */
+                    LifecycleFunc _uninitialize;
+                    /** Factories built so far by base class fingerprint, nullptr if the module refused */
+                    std::unordered_map<std::uint64_t, std::unique_ptr<factoryBase>> _factories;
+
+                    /** Non-Copyable */
+                    module(const module&) = delete;
+            };
+
+            /** Constructor */
+            library_registry() {}
+
+            /**
+             * Returns the module for a file, opening it unless a loader still uses it.
+             *
+             * The library is opened without holding the registry lock, so constructors of a library can load
+             * others through the same registry and different files open in parallel. Threads opening a file
+             * that is being opened wait for the result, opening a file from its own constructors throws
+             * libraryLoadException. Throws libraryFlagsException if the file is open with different flags.
+             */
+            std::shared_ptr<module> open(const std::string& file, int flags = 0) {
+                std::promise<std::shared_ptr<module>> promise;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    entry& e = _modules[file];
+
+                    std::shared_ptr<module> result = e.opened.lock();
+                    if (result)
+                        return checked(result, flags);
+
+                    if (e.opening.valid()) {
+                        if (e.opener == std::this_thread::get_id())
+                            throw libraryLoadException();
+
+                        std::shared_future<std::shared_ptr<module>> opening = e.opening;
+                        lock.unlock();
+                        return checked(opening.get(), flags);
+                    }
+
+                    e.opening = promise.get_future().share();
+                    e.opener = std::this_thread::get_id();
+                }
+
+                std::shared_ptr<module> result;
+                try {
+                    result = std::make_shared<module>(file, flags);
+                } catch (...) {
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _modules.erase(file);
+                    }
+                    promise.set_exception(std::current_exception());
+                    throw;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    entry& e = _modules[file];
+                    e.opened = result;
+                    e.opening = std::shared_future<std::shared_ptr<module>>();
+                }
+                promise.set_value(result);
+                return result;
+            }
+
+            /** Returns the number of libraries currently open. */
+            std::size_t size() const {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                std::size_t result = 0;
+                for (auto &it : _modules) {
+                    if (!it.second.opened.expired())
+                        ++result;
+                }
+                return result;
+            }
+
+            /** Returns the registry shared by the whole process. */
+            static const std::shared_ptr<library_registry>& global() {
+                static const std::shared_ptr<library_registry> registry = std::make_shared<library_registry>();
+                return registry;
+            }
+        private:
+            /** State of a file in the registry */
+            struct entry {
+                /** The module while a loader uses it */
+                std::weak_ptr<module> opened;
+                /** Result of the open in progress, invalid if there is none */
+                std::shared_future<std::shared_ptr<module>> opening;
+                /** Thread running the open in progress */
+                std::thread::id opener;
+            };
+
+            /** Returns the module if it was opened with the given flags, throws libraryFlagsException otherwise */
+            static std::shared_ptr<module> checked(std::shared_ptr<module> result, int flags) {
+                // requiring the library to be open already is met by any module
+                int relevant = ~shared_library::SHLIB_NOLOAD_IMPL;
+                if ((result->flags() & relevant) != (flags & relevant))
+                    throw libraryFlagsException();
+                return result;
+            }
+
+            /** Modules by file, entries of closed libraries are reused when they are opened again */
+            std::unordered_map<std::string, entry> _modules;
+            /** Mutex protecting _modules */
+            mutable std::mutex _mutex;
+
+            /** Non-Copyable */
+            library_registry(const library_registry&) = delete;
+    };
+
+    /**
+     * Budget above which class_loader evicts idle libraries, see class_loader::set_eviction_policy.
+     *
+     * Limits of 0 are not enforced, eviction is disabled if neither limit is set.
+     */
+    struct eviction_policy {
+        /** Maximum number of loaded libraries */
+        std::size_t maxLibraries;
+        /** Maximum number of bytes mapped by loaded libraries, libraries of unknown size count as 0 */
+        std::size_t maxBytes;
+        /** Time a library has to be unused before it may be evicted */
+        std::chrono::milliseconds idle;
+
+        /** Constructor, disables eviction */
+        eviction_policy() : maxLibraries(0), maxBytes(0), idle(0) {}
+
+        /** Returns whether a limit is set */
+        bool enabled() const {
+            return (maxLibraries != 0 || maxBytes != 0);
+        }
+
+        /** Returns whether the given usage exceeds the budget */
+        bool exceeded(std::size_t libraries, std::size_t bytes) const {
+            return ((maxLibraries != 0 && libraries > maxLibraries) || (maxBytes != 0 && bytes > maxBytes));
+        }
+    };
+
+    /**
+     * Loads exported C++ classes extending a common base class from a shared library.
+     *
+     * The optional observer O is informed about load and create timings, see module_observer.hpp.
+     */
+    template <class B, class O = null_observer>
     class class_loader {
         public:
             /** Definition the factory of the base class. */
             typedef factory<std::string, B> Factory;
 
-            /** Struct containing information about a loaded library. */
-            struct libraryInfo {
+            /** Rules applied when two libraries export a class under the same name. */
+            enum ConflictPolicy {
+                /** The library loaded first keeps the name, later exports are shadowed */
+                CONFLICT_KEEP_FIRST = 0,
+                /** The library loaded last takes over the name */
+                CONFLICT_REPLACE    = 1,
+                /** Loading a library exporting an already known name fails */
+                CONFLICT_THROW      = 2
+            };
+
+            /** Definition for optional initialization function. */
+            typedef void (*InitializeLibraryFunc)();
+
+            /** Definition for optional uninitialization function. */
+            typedef void (*UninitializeLibraryFunc)();
+
+            /** Definition for build function */
+            typedef bool (*BuildFactoryFunc)(Factory*);
+
+            /**
+             * Struct containing information about a loaded library.
+             *
+             * Owned by the snapshots referencing it, the library is uninitialized and closed once the
+             * last of them is gone.
+             */
+            struct libraryInfo : public std::enable_shared_from_this<libraryInfo> {
+                /** Path the library was loaded from */
+                std::string path;
                 /** Pointer to shared_library object */
                 shared_library* pLibrary;
-                /** Pointer to factory */
+                /** Pointer to factory, nullptr for libraries exporting a manifest */
                 const Factory* pFactory;
-                /** Reference count for shared library */
+                /** Manifest entries sorted by name, nullptr for libraries building a factory */
+                const manifestEntry* pManifest;
+                /** Number of manifest entries */
+                std::size_t manifestSize;
+                /** Reference count for shared library, only touched while holding the loader mutex */
                 mutable int refCount;
+                /** Position in load order, used to resolve class name conflicts */
+                std::uint64_t order;
+                /** Flags the library was opened with, reused by reload */
+                int flags;
+                /** Whether the factory was built and uninitializeLibrary has to be called */
+                bool initialized;
+                /** Optional uninitialization function, resolved at load */
+                UninitializeLibraryFunc uninitialize;
+                /** Number of instances from create_unique, create_shared and friends still alive */
+                mutable std::atomic<long> live;
+                /** Temporary copy created by reload that could not be removed while loaded */
+                std::string copyPath;
+                /** Bytes mapped for the library, 0 if unknown */
+                std::size_t mappedBytes;
+                /** Stamp of the file at path taken before it was opened, see stamped */
+                library_image::stamp stamp;
+                /** Whether stamp is known, bundled libraries have none */
+                bool stamped;
+                /** Time of the last create, in clock ticks, only tracked while eviction is enabled */
+                mutable std::atomic<std::int64_t> lastUse;
+                /** Whether instances nothing tracks were created or eviction was opted out of, see set_evictable */
+                mutable std::atomic<bool> pinned;
+                /** Counters of the classes in forEachClass order, only counted while statistics are enabled */
+                std::unique_ptr<class_counters> counters;
+                /** Time taken to open, initialize and build the library */
+                std::chrono::nanoseconds loadTime;
+                /** Module of the registry the library was opened from, owns pLibrary and pFactory if set */
+                std::shared_ptr<library_registry::module> module;
+                /** Bundle the library was loaded from, see load_bundle */
+                std::shared_ptr<const bundle_image> bundle;
+                /** Index of the library in the bundle */
+                std::size_t member;
+                /** File the bundled library was opened from, released once it is closed */
+                std::unique_ptr<bundle_file> extracted;
+
+                /** Constructor */
+                libraryInfo() : pLibrary(nullptr), pFactory(nullptr), pManifest(nullptr), manifestSize(0), refCount(0), order(0), flags(0), initialized(false), uninitialize(nullptr), live(0), mappedBytes(0), stamp(), stamped(false), lastUse(0), pinned(false), loadTime(0), member(0) {}
+
+                /** Destructor, frees the library ressources */
+                ~libraryInfo() {
+                    if (module) {
+                        // the last loader using the module closes it
+                        module.reset();
+                    } else {
+                        if (initialized && uninitialize != nullptr) {
+                            uninitialize();
+                        }
+
+                        // unload prior deleting
+                        delete pFactory;
+                        if (pLibrary != nullptr) {
+                            pLibrary->unload();
+                            delete pLibrary;
+                        }
+                    }
+
+                    extracted.reset();
+
+                    if (!copyPath.empty())
+                        std::remove(copyPath.c_str());
+                }
+            private:
+                /** Non-Copyable */
+                libraryInfo(const libraryInfo&) = delete;
             };
 
-            /** Type for a map containing different loaded libraries. */
-            typedef std::unordered_map<std::string, libraryInfo> libraryMap;
+            /** Type for a map containing different loaded libraries, keys reference libraryInfo::path. */
+            typedef std::unordered_map<string_ref, std::shared_ptr<libraryInfo>, string_ref_hash> libraryMap;
 
             /** Definition for factory creator for base class */
             typedef factoryCreator<B> Creator;
 
-            /** Definition for optional initialization function. */
-            typedef void (*InitializeLibraryFunc)();
+            /** Struct pointing a class name at the library currently providing it. */
+            struct classInfo {
+                /** Creator for the class */
+                const Creator* pCreator;
+                /** Library the creator belongs to */
+                const libraryInfo* pInfo;
+                /** Position of the class in forEachClass order, indexes libraryInfo::counters */
+                std::size_t slot;
+            };
 
-            /** Definition for optional uninitialization function. */
-            typedef void (*UninitializeLibraryFunc)();
+            /** Type for the loader-wide index of class names, keys reference the providing factory. */
+            typedef std::unordered_map<string_ref, classInfo, string_ref_hash> classMap;
 
-            /** Definition for build function */
-            typedef bool (*BuildFactoryFunc)(Factory*);
+            /** Library registered by load_lazy or evicted, loaded on first use of one of its classes. */
+            struct lazyInfo {
+                /** Path of the library */
+                std::string path;
+                /** Names of the classes the library provides */
+                std::vector<std::string> classes;
+                /** Flags to load the library with */
+                int flags;
+                /** Reference count to restore once loaded */
+                int refCount;
+                /** Bundle containing the library, nullptr for libraries loaded from their own file */
+                std::shared_ptr<const bundle_image> bundle;
+                /** Index of the library in the bundle */
+                std::size_t member;
+                /** Error loading the library on demand failed with, creates rethrow it instead of retrying */
+                std::exception_ptr error;
+
+                /** Constructor */
+                lazyInfo() : flags(0), refCount(0), member(0) {}
+            };
+
+            /** Type for the index of lazily registered class names, keys reference lazyInfo::classes. */
+            typedef std::unordered_map<string_ref, std::shared_ptr<const lazyInfo>, string_ref_hash> lazyMap;
+
+            /**
+             * Immutable view of the loaded libraries and their classes.
+             *
+             * load() and unload() publish a modified copy, readers keep using the snapshot they
+             * acquired until they are done with it.
+             */
+            struct snapshot : public std::enable_shared_from_this<snapshot> {
+                /** Loaded libraries */
+                libraryMap libraries;
+                /** Loader-wide class index */
+                classMap classes;
+                /** Classes of libraries registered by load_lazy and not loaded yet */
+                lazyMap lazy;
+            };
+
+            /** Shared pointer type snapshots are published as */
+            typedef std::shared_ptr<const snapshot> snapshotPtr;
+
+            /** Classes looked up by the calling thread, see set_thread_cache. */
+            struct threadCache {
+                /** Id of the loader the cache belongs to, 0 if it has to be refreshed */
+                std::uint64_t loader;
+                /** Loader generation the cache belongs to */
+                std::uint64_t generation;
+                /** Snapshot keeping the cached entries valid */
+                snapshotPtr snap;
+                /** Cached index entries, keys reference the snapshot */
+                std::unordered_map<string_ref, const classInfo*, string_ref_hash> classes;
+
+                /** Constructor */
+                threadCache() : loader(0), generation(0) {}
+
+                /**
+                 * Drops all entries and starts over with the given snapshot.
+                 *
+                 * A create further up the stack, e.g. the one calling the constructor creating through a
+                 * loader again, may still use an entry of the old snapshot. It is retired instead of released,
+                 * so it and its libraries stay alive until the read sections started before are done.
+                 */
+                void reset(std::uint64_t id, std::uint64_t gen, const snapshotPtr& next) {
+                    classes.clear();
+                    epoch_domain::global().retire(std::move(snap));
+                    snap = next;
+                    loader = id;
+                    generation = gen;
+                }
+
+                /** Returns the cache of the calling thread */
+                static threadCache& local() {
+                    static thread_local threadCache cache;
+                    return cache;
+                }
+            };
+
+            /**
+             * Deleter for instances owned by smart pointers.
+             *
+             * Holds a reference on the library of the instance, so unloading it only closes the library
+             * once the last instance is gone.
+             */
+            class deleter : public factoryDeleter<B> {
+                public:
+                    /** Constructs an empty deleter */
+                    deleter() {}
+
+                    /** Constructs a deleter for an instance of the given library, counting its destruction in slot unless uncounted */
+                    deleter(const Creator* creator, const std::shared_ptr<const libraryInfo>& library, arena* a = nullptr,
+                        std::size_t slot = uncounted()) : factoryDeleter<B>(creator, a), _library(library), _slot(slot) {}
+
+                    /** Destroys the instance and releases the library reference */
+                    void operator () (B* b) const {
+                        factoryDeleter<B>::operator()(b);
+                        if (_slot != uncounted())
+                            _library->counters->destroyed(_slot);
+                        _library->live.fetch_sub(1, std::memory_order_relaxed);
+                        _library.reset();
+                    }
+
+                    /** Returns the library the instance belongs to */
+                    const std::shared_ptr<const libraryInfo>& library() const {
+                        return _library;
+                    }
+                private:
+                    /** Library of the instance */
+                    mutable std::shared_ptr<const libraryInfo> _library;
+                    /** Counter slot of the class or uncounted */
+                    std::size_t _slot;
+            };
+
+            /** Unique pointer for instances keeping their library loaded */
+            typedef std::unique_ptr<B, deleter> instance_ptr;
+
+            /** Smart pointer for objects from create_pooled and create_in, hands them back to their creator */
+            typedef instance_ptr pooled_ptr;
+
+            /**
+             * Instances from create_many, constructed next to each other in one allocation.
+             *
+             * Keeps the library of the instances loaded like create_unique, all instances are destroyed
+             * together with the block.
+             */
+            class instance_block {
+                public:
+                    /** Constructs an empty block */
+                    instance_block() : _slot(uncounted()) {}
+
+                    /** Takes the instances of a block created by the given library, counting their destruction in slot unless uncounted */
+                    instance_block(factoryBlock<B>&& block, const std::shared_ptr<const libraryInfo>& library, std::size_t slot = uncounted())
+                        : _block(std::move(block)), _library(library), _slot(slot)
+                    {
+                        _library->live.fetch_add(static_cast<long>(_block.size()), std::memory_order_relaxed);
+                    }
+
+                    /** Move constructor */
+                    instance_block(instance_block&& b) : _block(std::move(b._block)), _library(std::move(b._library)), _slot(b._slot) {}
+
+                    /** Move assignment, destroys the instances held so far */
+                    instance_block& operator = (instance_block&& b) {
+                        if (this != &b) {
+                            reset();
+                            _block = std::move(b._block);
+                            _library = std::move(b._library);
+                            _slot = b._slot;
+                        }
+                        return *this;
+                    }
+
+                    /** Destroys the instances and releases the library reference */
+                    ~instance_block() {
+                        reset();
+                    }
+
+                    /** Returns the i-th instance */
+                    B* operator [] (std::size_t i) const {
+                        return _block[i];
+                    }
+
+                    /** Returns the number of instances */
+                    std::size_t size() const {
+                        return _block.size();
+                    }
+
+                    /** Checks if the block holds no instances */
+                    bool empty() const {
+                        return _block.empty();
+                    }
+
+                    /** Destroys all instances and releases the library reference */
+                    void reset() {
+                        std::size_t n = _block.size();
+                        _block.clear();
+                        if (_library) {
+                            if (_slot != uncounted() && n > 0)
+                                _library->counters->destroyed(_slot, n);
+                            _library->live.fetch_sub(static_cast<long>(n), std::memory_order_relaxed);
+                            _library.reset();
+                        }
+                    }
+
+                    /** Returns the library the instances belong to */
+                    const std::shared_ptr<const libraryInfo>& library() const {
+                        return _library;
+                    }
+                private:
+                    /** Instances of the block */
+                    factoryBlock<B> _block;
+                    /** Library of the instances */
+                    std::shared_ptr<const libraryInfo> _library;
+                    /** Counter slot of the class or uncounted */
+                    std::size_t _slot;
+
+                    /** Prevent copying */
+                    instance_block(const instance_block&) = delete;
+            };
 
             /** The loaders very own iterator class */
             class Iterator {
                 public:
+                    /** Path and factory of a library, the factory is nullptr for libraries exporting a manifest */
                     typedef std::pair<std::string, const Factory*> Pair;
                 private:
+                    snapshotPtr _snapshot;
                     typename libraryMap::const_iterator _it;
                     mutable Pair _pair;
                 public:
-                    Iterator(const typename libraryMap::const_iterator& it) {
+                    Iterator(const snapshotPtr& snapshot, const typename libraryMap::const_iterator& it) {
+                        _snapshot = snapshot;
                         _it = it;
                     }
 
                     Iterator(const Iterator& it) {
+                        _snapshot = it._snapshot;
                         _it = it._it;
                     }
 
                     ~Iterator() {}
 
                     Iterator& operator = (const Iterator& it) {
+                        _snapshot = it._snapshot;
                         _it = it._it;
                         return *this;
                     }
@@ -141,172 +807,1547 @@ namespace modulepp {
                     }
 
                     Iterator operator ++ (int) {
-                        Iterator result(_it);
+                        Iterator result(_snapshot, _it);
                         ++_it;
                         return result;
                     }
 
                     inline const Pair* operator * () const {
-                        _pair.first  = _it->first;
-                        _pair.second = _it->second.pFactory;
+                        _pair.first  = _it->second->path;
+                        _pair.second = _it->second->pFactory;
                         return &_pair;
                     }
 
                     inline const Pair* operator -> () const {
-                        _pair.first  = _it->first;
-                        _pair.second = _it->second.pFactory;
+                        _pair.first  = _it->second->path;
+                        _pair.second = _it->second->pFactory;
                         return &_pair;
                     }
             };
 
+            /**
+             * Class name resolved to its creator once.
+             *
+             * The handle keeps the library of the creator alive and only repeats the lookup after
+             * the loader published a new generation of libraries. A handle may be shared between threads
+             * as long as only one of them calls create() at a time, the loader has to outlive it.
+             */
+            class handle {
+                public:
+                    /** Constructs an empty handle */
+                    handle() : _loader(nullptr), _creator(nullptr), _slot(0), _generation(0) {}
+
+                    /** Returns a new instance of the class, re-resolving the name if libraries changed, pins it like create */
+                    B* create() {
+                        if (_loader == nullptr)
+                            throw libraryCreateException();
+
+                        if (_loader->_generation.load(std::memory_order_acquire) != _generation)
+                            *this = _loader->resolve(_name);
+
+                        _loader->touch(*_library);
+                        pin(*_library);
+                        const Creator* cre = _creator;
+                        return _loader->observeCreate(classInfo{cre, _library.get(), _slot}, _name, [cre]() { return cre->create(); });
+                    }
+
+                    /** Returns true if the loader changed since the name was resolved */
+                    bool stale() const {
+                        return (_loader == nullptr || _loader->_generation.load(std::memory_order_acquire) != _generation);
+                    }
+
+                    /** Returns the name of the class */
+                    const std::string& name() const {
+                        return _name;
+                    }
+                private:
+                    friend class class_loader;
+
+                    /** Loader the handle was resolved from */
+                    const class_loader* _loader;
+                    /** Name of the class */
+                    std::string _name;
+                    /** Library providing the class, kept alive while the handle exists */
+                    std::shared_ptr<const libraryInfo> _library;
+                    /** Creator for the class */
+                    const Creator* _creator;
+                    /** Counter slot of the class */
+                    std::size_t _slot;
+                    /** Loader generation the handle belongs to */
+                    std::uint64_t _generation;
+            };
+
+            /** Constructor, conflicting class names are resolved using the given policy */
+            class_loader(ConflictPolicy policy = CONFLICT_KEEP_FIRST, const O& observer = O())
+                : _head(nullptr), _owner(std::make_shared<snapshot>()), _generation(0), _policy(policy), _order(0),
+                  _observer(observer), _tracking(false), _id(nextId()), _caching(false), _counting(false), _stopping(false)
+            {
+                _head.store(_owner.get(), std::memory_order_release);
+            }
 
-            /** Destructor, frees left over library ressources */
+            /**
+             * Constructor, libraries are opened through the given registry and shared with the other loaders using it.
+             *
+             * Conflicting class names are resolved using the given policy. Loading a library another loader has
+             * open with different flags throws libraryFlagsException.
+             */
+            explicit class_loader(const std::shared_ptr<library_registry>& registry, ConflictPolicy policy = CONFLICT_KEEP_FIRST, const O& observer = O())
+                : class_loader(policy, observer)
+            {
+                _registry = registry;
+            }
+
+            /** Destructor, finishes pending asynchronous jobs, frees left over library ressources once no reader uses them anymore */
             virtual ~class_loader() {
+                {
+                    std::lock_guard<std::mutex> lock(_jobMutex);
+                    _stopping = true;
+                }
+                _jobCondition.notify_one();
+
+                if (_worker.joinable())
+                    _worker.join();
+
+                // free the snapshots retired by this loader already, unless a reader still uses them
+                epoch_domain::global().collect();
+            }
+
+            /** Result of loading a single library as part of a batch. */
+            struct loadResult {
+                /** Path of the library */
+                std::string path;
+                /** Exception thrown while loading, null on success */
+                std::exception_ptr error;
+            };
+
+            /**
+             * Loads a library from the given path.
+             *
+             * The options only apply when the library is opened, loading it again just adds a reference.
+             */
+            void load(string_ref path, const load_options& options = load_options()) {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::uint64_t first = _order + 1;
+                loadLocked(path, options.flags());
+                evictLocked(first);
+            }
+
+            /**
+             * Registers a library to be loaded the first time one of its classes is created.
+             *
+             * The class names are read from the manifest of the library without loading it, see probe.
+             * Until then has() reports the classes and the library costs nothing but its registration.
+             * Creating a class of a registered library loads it once, later creates take the usual path.
+             * If loading it fails, has() stops reporting its classes and creating them rethrows the error
+             * without trying again, until the library is loaded or registered again. Registering a loaded,
+             * registered or evicted library adds a reference to it, like load. Throws libraryManifestException
+             * if the library was not built for B.
+             */
+            void load_lazy(const std::string& path, const load_options& options = load_options()) {
+                library_metadata metadata = probe(path);
+                if (!metadata.compatible)
+                    throw libraryManifestException();
+
+                load_lazy(path, metadata.classes, options);
+            }
+
+            /** Registers a library providing the given classes to be loaded on first use, see load_lazy. */
+            void load_lazy(const std::string& path, const std::vector<std::string>& classes,
+                const load_options& options = load_options()) {
                 std::lock_guard<std::mutex> lock(mutex);
+                snapshotPtr snap = current();
 
-                for (auto &it : _map) {
-                    it.second.pLibrary->unload();
-                    delete it.second.pLibrary;
-                    delete it.second.pFactory;
+                auto it = snap->libraries.find(path);
+                if (it != snap->libraries.end()) {
+                    ++it->second->refCount;
+                    return;
                 }
+
+                // registered and evicted libraries keep their registration and gain a reference
+                std::shared_ptr<const lazyInfo> registered = snap->lazy.empty() ? nullptr : findLazy(*snap, path);
+                std::shared_ptr<lazyInfo> info;
+                if (registered) {
+                    info = std::make_shared<lazyInfo>(*registered);
+                    info->error = nullptr;
+                    ++info->refCount;
+                } else {
+                    info = std::make_shared<lazyInfo>();
+                    info->path = path;
+                    info->classes = classes;
+                    info->flags = options.flags();
+                    info->refCount = 1;
+                }
+
+                std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*snap);
+                dropLazy(*next, path);
+                addLazy(*next, info);
+                publish(next);
             }
 
-            /** Loads a library from the given path */
-            void load(const std::string& path) {
+            /** Registers all compatible libraries with a manifest found in a directory, see load_lazy. */
+            void load_lazy_directory(const std::string& directory, const load_options& options = load_options()) {
+                for (auto &metadata : probe_directory(directory)) {
+                    if (metadata.compatible)
+                        load_lazy(metadata.path, metadata.classes, options);
+                }
+            }
+
+            /**
+             * Registers the libraries of a bundle to be loaded the first time one of their classes is created.
+             *
+             * The bundle is mapped and its index read once, the libraries are registered like by load_lazy as
+             * "<bundle>/<name>" and can be loaded and unloaded by that path. A library is written out to a
+             * memory file, or a temporary file where there are none, when it is loaded. Reloading bundled
+             * libraries is not supported. Throws libraryBundleException if the bundle cannot be read and
+             * libraryManifestException if a library with a manifest was not built for B.
+             */
+            void load_bundle(const std::string& file, const load_options& options = load_options()) {
+                std::shared_ptr<const bundle_image> image = std::make_shared<bundle_image>(file);
+                for (auto &member : image->members()) {
+                    if (member.fingerprint != 0 && (member.version != FACTORY_ABI_VERSION || member.fingerprint != fingerprint_of<B>()))
+                        throw libraryManifestException();
+                }
+
                 std::lock_guard<std::mutex> lock(mutex);
+                snapshotPtr snap = current();
+                std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*snap);
 
-                // check if library has already been loaded
-                auto it = _map.find(path);
-                if (it == _map.end()) {
-                    // create info struct for library
-                    libraryInfo li;
-                    li.pLibrary = new shared_library();
-                    li.pLibrary->load(path);
-                    li.pFactory = new Factory();
-                    li.refCount = 1;
+                for (std::size_t i = 0; i < image->members().size(); ++i) {
+                    std::string path = file + "/" + image->members()[i].name;
+                    auto it = snap->libraries.find(path);
+                    if (it != snap->libraries.end()) {
+                        ++it->second->refCount;
+                        continue;
+                    }
 
-                    try {
-                        // initialize symbol (optional)
-                        if (li.pLibrary->hasSymbol("initializeLibrary")) {
-                            InitializeLibraryFunc initializeLibrary =
-                                reinterpret_cast<InitializeLibraryFunc> ( li.pLibrary->findSymbol("initializeLibrary") );
+                    std::shared_ptr<lazyInfo> info = std::make_shared<lazyInfo>();
+                    info->path = path;
+                    info->classes = image->members()[i].classes;
+                    info->flags = options.flags();
+                    info->refCount = 1;
+                    info->bundle = image;
+                    info->member = i;
+
+                    dropLazy(*next, path);
+                    addLazy(*next, info);
+                }
+                publish(next);
+            }
+
+            /**
+             * Loads several libraries in parallel.
+             *
+             * Libraries are opened, initialized and built by up to the given number of threads, 0 using one
+             * per hardware thread, threads that cannot be started leave their share to the others. The loader
+             * is only locked to pick the libraries to open and to publish them, other loads and unloads go on
+             * in between. The results are published at once in the order of paths. Errors are reported per
+             * library and do not affect the others.
+             */
+            std::vector<loadResult> load_all(const std::vector<std::string>& paths, unsigned threads = 0,
+                const load_options& options = load_options()) {
+                std::vector<loadResult> results(paths.size());
+                std::vector<std::shared_ptr<libraryInfo>> opened(paths.size());
+                std::vector<std::shared_ptr<const lazyInfo>> sources(paths.size());
+                std::vector<std::size_t> pending;
+                std::vector<std::uint64_t> order(paths.size(), 0);
 
-                            initializeLibrary();
+                // only the first occurrence of a path not yet loaded is opened, in the load order reserved here
+                std::unordered_map<string_ref, std::size_t, string_ref_hash> first;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    snapshotPtr snap = current();
+                    for (std::size_t i = 0; i < paths.size(); ++i) {
+                        results[i].path = paths[i];
+                        if (snap->libraries.find(paths[i]) == snap->libraries.end() && first.insert(std::make_pair(string_ref(paths[i]), i)).second) {
+                            pending.push_back(i);
+                            order[i] = ++_order;
+                            if (!snap->lazy.empty())
+                                sources[i] = findLazy(*snap, paths[i]);
                         }
+                    }
+                }
+
+                // open libraries on worker threads, loads and lookups go on meanwhile
+                std::atomic<std::size_t> nextJob(0);
+                auto worker = [&]() {
+                    for (std::size_t job = nextJob++; job < pending.size(); job = nextJob++) {
+                        std::size_t i = pending[job];
+                        try {
+                            opened[i] = openFrom(paths[i], order[i], options.flags(), sources[i].get());
+                        } catch (...) {
+                            results[i].error = std::current_exception();
+                        }
+                    }
+                };
 
-                        // build (required)
-                        if (li.pLibrary->hasSymbol("buildFactory")) {
-                            BuildFactoryFunc buildManifest =
-                                reinterpret_cast<BuildFactoryFunc> ( li.pLibrary->findSymbol("buildFactory") );
+                if (threads == 0)
+                    threads = std::max(1u, std::thread::hardware_concurrency());
 
-                            if (buildManifest(const_cast<Factory*>(li.pFactory))) {
-                                _map[path] = li;
-                            }
+                // without resources for more threads the ones started so far process all jobs
+                std::vector<std::thread> workers;
+                try {
+                    std::size_t count = std::min<std::size_t>(threads, pending.size());
+                    workers.reserve(count);
+                    for (std::size_t i = 1; i < count; ++i) {
+                        workers.emplace_back(worker);
+                    }
+                } catch (...) {
+                }
+                worker();
+                for (auto &t : workers) {
+                    t.join();
+                }
+
+                // publish everything in one snapshot, libraries loaded by others meanwhile are only referenced
+                std::lock_guard<std::mutex> lock(mutex);
+                std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*current());
+                std::vector<std::size_t> missing;
+                for (std::size_t i = 0; i < paths.size(); ++i) {
+                    auto it = next->libraries.find(paths[i]);
+                    if (opened[i]) {
+                        if (it != next->libraries.end()) {
+                            ++it->second->refCount;
+                            opened[i].reset();
+                            continue;
+                        }
+
+                        // registered and evicted libraries keep the references they had while unloaded
+                        std::shared_ptr<const lazyInfo> registered = next->lazy.empty() ? nullptr : findLazy(*next, paths[i]);
+                        if (registered)
+                            opened[i]->refCount += registered->refCount;
+
+                        try {
+                            addLibrary(*next, opened[i]);
+                        } catch (...) {
+                            results[i].error = std::current_exception();
+                        }
+                    } else if (order[i] == 0) {
+                        // already loaded or a duplicate, shares the fate of the first occurrence
+                        if (it != next->libraries.end()) {
+                            ++it->second->refCount;
+                        } else if (first.find(paths[i]) != first.end()) {
+                            results[i].error = results[first[paths[i]]].error;
                         } else {
-                            throw librarySymbolMissingException();
+                            // was loaded but unloaded meanwhile
+                            missing.push_back(i);
                         }
+                    }
+                }
+                publish(next);
+
+                for (std::size_t i : missing) {
+                    try {
+                        loadLocked(paths[i], options.flags());
                     } catch (...) {
-                        // forward any exceptions thrown
-                        delete li.pFactory;
-                        delete li.pLibrary;
-                        throw;
+                        results[i].error = std::current_exception();
                     }
-                } else {
-                    // increase reference count if library was already loaded
-                    ++it->second.refCount;
                 }
+                evictLocked(pending.empty() ? _order + 1 : order[pending.front()]);
+
+                return results;
+            }
+
+            /**
+             * Loads a library on the background thread of the loader.
+             *
+             * Lookups keep using the previously published libraries until the load is complete. The
+             * future holds any exception thrown by load.
+             */
+            std::future<void> load_async(const std::string& path, const load_options& options = load_options()) {
+                return enqueue([this, path, options]() { this->load(path, options); });
+            }
+
+            /** Unloads a library on the background thread of the loader, see load_async. */
+            std::future<void> unload_async(const std::string& path) {
+                return enqueue([this, path]() { this->unload(path); });
+            }
+
+            /** Loads all libraries found in a directory in parallel, see load_all. */
+            std::vector<loadResult> load_directory(const std::string& directory, unsigned threads = 0,
+                const load_options& options = load_options()) {
+                return load_all(shared_library::listLibraries(directory), threads, options);
+            }
+
+            /**
+             * Replaces a loaded library with the current build at its path.
+             *
+             * The new build is loaded from a temporary copy next to the original, so the operating system
+             * doesn't hand out the already loaded image, and takes over the classes of the old one in a
+             * single snapshot. Lookups never fail in between. The old generation is closed once the last
+             * snapshot, handle and smart pointer instance referencing it is gone. Libraries not loaded yet
+             * are simply loaded. If the new build fails to load, the old one stays in place.
+             *
+             * Copies are opened with the options of the old generation but local symbol binding, classes
+             * referencing symbols of their own library should be built with hidden visibility or -Bsymbolic
+             * to avoid binding to an old generation.
+             */
+            void reload(string_ref path) {
+                std::lock_guard<std::mutex> lock(mutex);
+                snapshotPtr snap = current();
+
+                auto it = snap->libraries.find(path);
+                if (it == snap->libraries.end()) {
+                    std::shared_ptr<libraryInfo> li = openLibrary(path, ++_order);
+                    if (!li)
+                        return;
+
+                    std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*snap);
+                    addLibrary(*next, li);
+                    publish(next);
+                    return;
+                }
+
+                const libraryInfo& old = *it->second;
+
+                // copy the library, the copy is removed right away where open files can be deleted
+                library_image::stamp stamp;
+                bool stamped = library_image::fileStamp(old.path + shared_library::suffix(), stamp);
+                std::string copy = old.path + ".gen" + std::to_string(++_order);
+                copyFile(old.path + shared_library::suffix(), copy + shared_library::suffix());
+
+                std::shared_ptr<libraryInfo> li;
+                try {
+                    // the copy is never mapped yet, so probing with noload would always fail
+                    int flags = old.flags & ~(shared_library::SHLIB_GLOBAL_IMPL | shared_library::SHLIB_NOLOAD_IMPL);
+                    li = openLibrary(path, old.order, copy, flags | shared_library::SHLIB_LOCAL_IMPL);
+                } catch (...) {
+                    std::remove((copy + shared_library::suffix()).c_str());
+                    throw;
+                }
+
+                if (std::remove((copy + shared_library::suffix()).c_str()) != 0 && li)
+                    li->copyPath = copy + shared_library::suffix();
+
+                if (!li)
+                    return;
+
+                li->refCount = old.refCount;
+                li->flags = old.flags;
+                li->stamp = stamp;
+                li->stamped = stamped;
+
+                // swap generations in a single snapshot
+                std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*snap);
+                unindexLibrary(*next, old);
+                next->libraries.erase(it->first);
+                addLibrary(*next, li);
+                publish(next);
             }
 
-            /** Unload a shared library, invalidates all references to it. */
-            void unload(const std::string& path) {
+            /**
+             * Unload a shared library, its ressources are freed once no reader or object references them.
+             *
+             * Libraries registered by load_lazy and not loaded yet are unregistered. Libraries of a bundle
+             * are registered again like by load_bundle once unloaded, unloading them once more unregisters them.
+             */
+            void unload(string_ref path) {
                 std::lock_guard<std::mutex> lock(mutex);
+                snapshotPtr snap = current();
 
                 // check if library exists
-                auto it = _map.find(path);
-                if (it != _map.end()) {
-                    if (--it->second.refCount == 0) {
-                        // check for optional uninitialize symbol
-                        if (it->second.pLibrary->hasSymbol("uninitializeLibrary")) {
-                            UninitializeLibraryFunc uninitializeLibrary =
-                                reinterpret_cast<UninitializeLibraryFunc> ( it->second.pLibrary->findSymbol("uninitializeLibrary") );
-
-                            uninitializeLibrary();
+                auto it = snap->libraries.find(path);
+                if (it != snap->libraries.end()) {
+                    if (--it->second->refCount == 0) {
+                        // publish a copy without the library
+                        std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*snap);
+                        unindexLibrary(*next, *it->second);
+                        if (it->second->bundle) {
+                            std::shared_ptr<lazyInfo> info = registration(*it->second);
+                            info->refCount = 1;
+                            addLazy(*next, info);
                         }
+                        next->libraries.erase(it->first);
+                        publish(next);
+                    }
+                } else if (!snap->lazy.empty()) {
+                    std::shared_ptr<const lazyInfo> info = findLazy(*snap, path);
+                    if (!info)
+                        return;
 
-                        // unload prior deleting
-                        delete it->second.pFactory;
-                        it->second.pLibrary->unload();
-                        delete it->second.pLibrary;
-                        _map.erase(it);
+                    // evicted libraries keep their reference count while unloaded
+                    std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*snap);
+                    dropLazy(*next, path);
+                    if (info->refCount > 1) {
+                        std::shared_ptr<lazyInfo> remaining = std::make_shared<lazyInfo>(*info);
+                        --remaining->refCount;
+                        addLazy(*next, remaining);
                     }
+                    publish(next);
                 }
             }
 
-            /** Returns whether a specific class can be created. */
-            bool has(const std::string& className) {
-                return (getCreator(className) != nullptr);
+            /**
+             * Sets the budget above which idle libraries are evicted.
+             *
+             * The budget is enforced after every load, evicting the least recently used libraries without
+             * live instances from create_unique, create_shared and friends until it is met again. Evicted
+             * libraries are registered like by load_lazy and loaded again on their next create. Instances
+             * from create(), create_at() and handles are not tracked, libraries used that way are never
+             * evicted unless set_evictable says otherwise.
+             */
+            void set_eviction_policy(const eviction_policy& policy) {
+                std::lock_guard<std::mutex> lock(mutex);
+                _eviction = policy;
+                _tracking.store(policy.enabled(), std::memory_order_relaxed);
+                evictLocked(std::numeric_limits<std::uint64_t>::max());
             }
 
-            /** Returns a new instance of a class by its name. */
-            B* create(const std::string& className) {
-                const Creator* cre = getCreator(className);
-                if (cre == nullptr) {
-                    throw libraryCreateException();
-                } else {
-                    return cre->create();
+            /**
+             * Overrides whether a loaded library may be evicted.
+             *
+             * Libraries that must stay loaded opt out with false. true makes a library pinned by untracked
+             * instances evictable again, once the caller destroyed all of them, until the next untracked create.
+             */
+            void set_evictable(string_ref path, bool evictable) {
+                std::lock_guard<std::mutex> lock(mutex);
+                snapshotPtr snap = current();
+                auto it = snap->libraries.find(path);
+                if (it == snap->libraries.end())
+                    throw libraryAccessException();
+
+                it->second->pinned.store(!evictable, std::memory_order_relaxed);
+            }
+
+            /** Enforces the eviction budget now, for libraries going idle between loads. Returns the number evicted. */
+            std::size_t evict() {
+                std::lock_guard<std::mutex> lock(mutex);
+                return evictLocked(std::numeric_limits<std::uint64_t>::max());
+            }
+
+            /**
+             * Enables or disables the per-thread class cache of the loader.
+             *
+             * While enabled, each thread resolves class names through a private cache, so steady-state creates
+             * don't touch loader state shared with other threads. A cache is dropped once libraries are loaded or
+             * unloaded, until then it keeps the libraries it has seen loaded, unloading and eviction take effect
+             * when the thread creates its next instance, calls clear_thread_cache or exits. A thread caches the classes
+             * of one loader at a time, alternating between loaders of the same type refreshes the cache each time.
+             */
+            void set_thread_cache(bool enabled) {
+                _caching.store(enabled, std::memory_order_relaxed);
+            }
+
+            /** Releases the class cache of the calling thread, along with the libraries it kept loaded. */
+            static void clear_thread_cache() {
+                threadCache::local().reset(0, 0, snapshotPtr());
+            }
+
+            /**
+             * Enables or disables counting creates and destroys per class, see stats.
+             *
+             * Counters are kept in per-thread stripes of the library, so counting doesn't make threads creating
+             * the same class contend. Destroys are counted for instances released by their smart pointer or block,
+             * instances created while counting was disabled are never counted.
+             */
+            void set_stats(bool enabled) {
+                _counting.store(enabled, std::memory_order_relaxed);
+            }
+
+            /** Returns the statistics of all loaded libraries and their classes, see loader_stats::prometheus. */
+            loader_stats stats() const {
+                snapshotPtr snap = current();
+
+                std::vector<const libraryInfo*> libraries;
+                for (auto &it : snap->libraries) {
+                    libraries.push_back(it.second.get());
+                }
+                std::sort(libraries.begin(), libraries.end(), [](const libraryInfo* a, const libraryInfo* b) {
+                    return a->order < b->order;
+                });
+
+                loader_stats result;
+                for (const libraryInfo* li : libraries) {
+                    library_stats ls;
+                    ls.path = li->path;
+                    ls.live = li->live.load(std::memory_order_relaxed);
+                    ls.mappedBytes = li->mappedBytes;
+                    ls.loadTime = li->loadTime;
+
+                    std::size_t slot = 0;
+                    forEachClass(*li, [&](string_ref name, const Creator*) {
+                        ls.classes.push_back(class_stats{name.str(), li->counters->creates(slot), li->counters->destroys(slot)});
+                        ++slot;
+                    });
+                    result.libraries.push_back(std::move(ls));
+                }
+                return result;
+            }
+
+            /** Returns whether a specific class can be created, including classes of libraries registered by load_lazy and not failed to load. */
+            bool has(string_ref className) const {
+                epoch_guard guard;
+                const snapshot* snap = head();
+                if (snap->classes.find(className) != snap->classes.end())
+                    return true;
+
+                auto it = snap->lazy.find(className);
+                return (it != snap->lazy.end() && !it->second->error);
+            }
+
+            /**
+             * Returns a new instance of a class by its name, its library is no longer evicted, see set_evictable.
+             *
+             * Instances of classes exported with EXPORT_CLASS_ADVANCE are owned by their library and destroyed
+             * once it is closed. Use create_unique to destroy them earlier, through the creator that created them.
+             */
+            B* create(string_ref className) const {
+                // keep the snapshot alive until the object is created
+                epoch_guard guard;
+                const classInfo& ci = find(className);
+                const Creator* cre = ci.pCreator;
+                pin(*ci.pInfo);
+                return observeCreate(ci, className, [cre]() { return cre->create(); });
+            }
+
+            /**
+             * Returns a new instance owned by a unique pointer.
+             *
+             * The library of the instance stays loaded until the instance is destroyed, even if it is
+             * unloaded in the meantime. Pooled classes are taken from the pool of the NUMA node the
+             * calling thread runs on, see numa_node.
+             */
+            instance_ptr create_unique(string_ref className) const {
+                epoch_guard guard;
+                const classInfo& ci = find(className);
+                const Creator* cre = ci.pCreator;
+                return track(ci, observeCreate(ci, className, [cre]() { return cre->acquire(); }), nullptr);
+            }
+
+            /**
+             * Returns a new instance placed on the given NUMA node, kept like create_unique.
+             *
+             * Pooled classes take their storage from the pool of the node and hand it back there when
+             * destroyed on any thread, other classes ignore the node. Nodes up to numa_nodes() exist.
+             */
+            instance_ptr create_on(string_ref className, unsigned node) const {
+                epoch_guard guard;
+                const classInfo& ci = find(className);
+                const Creator* cre = ci.pCreator;
+                return track(ci, observeCreate(ci, className, [cre, node]() { return cre->acquire_on(node); }), nullptr);
+            }
+
+            /** Returns a new instance owned by a shared pointer, keeps the library loaded like create_unique. */
+            std::shared_ptr<B> create_shared(string_ref className) const {
+                return std::shared_ptr<B>(create_unique(className));
+            }
+
+            /** Returns a new instance using the per-node pool of its class, unpooled classes are created normally. */
+            pooled_ptr create_pooled(string_ref className) const {
+                return create_unique(className);
+            }
+
+            /** Returns a new instance constructed in storage from the given arena. */
+            pooled_ptr create_in(string_ref className, arena& a) const {
+                epoch_guard guard;
+                const classInfo& ci = find(className);
+                const Creator* cre = ci.pCreator;
+
+                void* storage = a.allocate(cre->size(), cre->alignment());
+                try {
+                    return track(ci, observeCreate(ci, className, [cre, storage]() { return cre->construct(storage); }), &a);
+                } catch (...) {
+                    a.deallocate(storage, cre->size(), cre->alignment());
+                    throw;
+                }
+            }
+
+            /**
+             * Creates n instances of a class in one contiguous block, writing a pointer to each of them to out.
+             *
+             * The class is looked up once and the instances are owned by the returned block, which keeps their
+             * library loaded like create_unique. The observer is notified once for the whole block.
+             */
+            template <typename OutputIt>
+            instance_block create_many(string_ref className, std::size_t n, OutputIt out) const {
+                epoch_guard guard;
+                const classInfo& ci = find(className);
+
+                clock::time_point start = now();
+                instance_block block(factoryBlock<B>(ci.pCreator, n), ci.pInfo->shared_from_this(), countedSlot(ci));
+                if (O::enabled)
+                    _observer.classCreated(className, since(start));
+                if (_counting.load(std::memory_order_relaxed) && n > 0)
+                    ci.pInfo->counters->created(ci.slot, n);
+
+                for (std::size_t i = 0; i < n; ++i, ++out) {
+                    *out = block[i];
                 }
+                return block;
+            }
+
+            /**
+             * Returns a new instance constructed from the given arguments, kept like create_unique.
+             *
+             * The argument types have to be given explicitly and match the EXPORT_CLASS_ARGS export of the
+             * class, otherwise factoryArgumentsException is thrown. Without arguments it equals create_unique.
+             */
+            template <typename... Args>
+            instance_ptr create_with(string_ref className, typename exact_argument<Args>::type... args) const {
+                epoch_guard guard;
+                const classInfo& ci = find(className);
+                const Creator* cre = ci.pCreator;
+                return track(ci, observeCreate(ci, className, [&]() {
+                    return createWith<Args...>(cre, std::integral_constant<bool, sizeof...(Args) == 0>(), std::forward<Args>(args)...);
+                }), nullptr);
+            }
+
+            /**
+             * Constructs an instance in the given storage without allocating, see size_of and alignment_of.
+             *
+             * Arguments are passed like for create_with. The instance doesn't own its storage nor keep its
+             * library loaded, it has to be destroyed by calling its destructor. Its library is no longer evicted.
+             */
+            template <typename... Args>
+            B* create_at(string_ref className, void* storage, typename exact_argument<Args>::type... args) const {
+                epoch_guard guard;
+                const classInfo& ci = find(className);
+                const Creator* cre = ci.pCreator;
+                pin(*ci.pInfo);
+                return observeCreate(ci, className, [&]() {
+                    return constructWith<Args...>(cre, storage, std::integral_constant<bool, sizeof...(Args) == 0>(), std::forward<Args>(args)...);
+                });
+            }
+
+            /**
+             * Returns a new instance of a class as interface I, or nullptr if the class doesn't implement it.
+             *
+             * The instance is kept like create_unique, the interfaces of a class are listed by EXPORT_CLASS_INTERFACES.
+             */
+            template <typename I>
+            std::shared_ptr<I> create_as(string_ref className) const {
+                epoch_guard guard;
+                const classInfo& ci = find(className);
+                const Creator* cre = ci.pCreator;
+                if (!cre->implements(fingerprint_of<I>()))
+                    return std::shared_ptr<I>();
+
+                std::shared_ptr<B> obj(track(ci, observeCreate(ci, className, [cre]() { return cre->acquire(); }), nullptr));
+                I* iface = static_cast<I*>(cre->query(obj.get(), fingerprint_of<I>()));
+                return std::shared_ptr<I>(obj, iface);
+            }
+
+            /** Returns whether instances of a class implement interface I. */
+            template <typename I>
+            bool implements(string_ref className) const {
+                epoch_guard guard;
+                return find(className).pCreator->implements(fingerprint_of<I>());
+            }
+
+            /** Returns an instance of the given class as interface I, nullptr if the class doesn't implement it. */
+            template <typename I>
+            I* query(string_ref className, B* obj) const {
+                epoch_guard guard;
+                return static_cast<I*>(find(className).pCreator->query(obj, fingerprint_of<I>()));
+            }
+
+            /** Returns an instance as interface I, nullptr if its class doesn't implement it. The class is known from the deleter. */
+            template <typename I>
+            static I* query(const instance_ptr& obj) {
+                if (!obj)
+                    return nullptr;
+
+                return static_cast<I*>(obj.get_deleter().creator()->query(obj.get(), fingerprint_of<I>()));
+            }
+
+            /** Returns the size of instances of a class, for storage passed to create_at. */
+            std::size_t size_of(string_ref className) const {
+                epoch_guard guard;
+                return find(className).pCreator->size();
+            }
+
+            /** Returns the alignment of instances of a class, for storage passed to create_at. */
+            std::size_t alignment_of(string_ref className) const {
+                epoch_guard guard;
+                return find(className).pCreator->alignment();
+            }
+
+            /** Resolves a class name into a handle, throws if the class cannot be created. */
+            handle resolve(string_ref className) const {
+                // read the generation first, a concurrent change results in an early re-resolve
+                handle h;
+                h._generation = _generation.load(std::memory_order_acquire);
+                epoch_guard guard;
+                const snapshot* snap = head();
+
+                const classInfo& ci = lookup(snap, className);
+                h._loader = this;
+                h._name = className.str();
+                h._library = ci.pInfo->shared_from_this();
+                h._creator = ci.pCreator;
+                h._slot = ci.slot;
+                return h;
             }
 
             /** Returns whether library a library is already loaded or not. */
-            bool loaded(const std::string& path) {
-                 return (getFactory(path) != nullptr);
+            bool loaded(string_ref path) const {
+                epoch_guard guard;
+                const snapshot* snap = head();
+                return (snap->libraries.find(path) != snap->libraries.end());
+            }
+
+            /**
+             * Reads the manifest of a library from its file without loading it, see probe_library.
+             *
+             * The result is only compatible if the library was built for B. Libraries building a factory
+             * instead of exporting a manifest cannot be probed.
+             */
+            library_metadata probe(const std::string& path) const {
+                library_metadata result = probe_library(path + shared_library::suffix());
+                result.path = path;
+                result.compatible = (result.compatible && result.fingerprint == fingerprint_of<B>());
+                return result;
+            }
+
+            /** Probes all libraries found in a directory, libraries that cannot be probed are skipped. */
+            std::vector<library_metadata> probe_directory(const std::string& directory) const {
+                std::vector<library_metadata> result;
+                for (auto &path : shared_library::listLibraries(directory)) {
+                    try {
+                        result.push_back(probe(path));
+                    } catch (libraryProbeException&) {
+                        // not a library or without manifest
+                    }
+                }
+                return result;
+            }
+
+            /** Returns the current snapshot of loaded libraries and classes. */
+            snapshotPtr current() const {
+                epoch_guard guard;
+                return head()->shared_from_this();
+            }
+
+            /**
+             * Returns a symbol exported by a loaded library converted to F, nullptr if it doesn't exist.
+             *
+             * Symbols are cached per library, the result is valid as long as the library stays loaded.
+             */
+            template <typename F>
+            F find_symbol(string_ref path, string_ref name) const {
+                epoch_guard guard;
+                const snapshot* snap = head();
+
+                auto it = snap->libraries.find(path);
+                if (it == snap->libraries.end())
+                    throw libraryAccessException();
+
+                return it->second->pLibrary->template findSymbol<F>(name);
+            }
+
+            /** Returns the observer of the loader. */
+            O& observer() {
+                return _observer;
             }
 
             /** Returns iterator pointing at the beginning of the class list. */
-            const Iterator begin() {
-                std::lock_guard<std::mutex> lock(mutex);
-                return Iterator(_map.begin());
+            const Iterator begin() const {
+                snapshotPtr snap = current();
+                return Iterator(snap, snap->libraries.begin());
             }
 
             /** Returns iterator pointing at the end of the class list. */
-            const Iterator end() {
-                std::lock_guard<std::mutex> lock(mutex);
-                return Iterator(_map.end());
+            const Iterator end() const {
+                snapshotPtr snap = current();
+                return Iterator(snap, snap->libraries.end());
             }
         private:
-            /** Map of libraries and their corresponding info object */
-            libraryMap _map;
-            /** Mutex for internal syncronisation. */
+            /** Currently published snapshot, read inside an epoch_guard without touching its reference count */
+            std::atomic<const snapshot*> _head;
+            /** Owner of the published snapshot, only replaced while holding the loader mutex */
+            snapshotPtr _owner;
+            /** Increased every time a snapshot is published */
+            std::atomic<std::uint64_t> _generation;
+            /** Policy for class names exported by more than one library */
+            ConflictPolicy _policy;
+            /** Number of libraries loaded so far */
+            std::uint64_t _order;
+            /** Observer informed about timings */
+            mutable O _observer;
+            /** Budget for loaded libraries */
+            eviction_policy _eviction;
+            /** Whether library use is tracked for eviction */
+            std::atomic<bool> _tracking;
+            /** Id distinguishing the loader in thread caches, never reused */
+            const std::uint64_t _id;
+            /** Whether creates go through the thread cache */
+            std::atomic<bool> _caching;
+            /** Whether creates and destroys are counted */
+            std::atomic<bool> _counting;
+            /** Registry libraries are opened from, nullptr if they are opened privately */
+            std::shared_ptr<library_registry> _registry;
+            /** Mutex serializing load() and unload(), readers never take it. */
             mutable std::mutex mutex;
+            /** Background thread running asynchronous jobs, started on demand */
+            std::thread _worker;
+            /** Pending asynchronous jobs */
+            std::deque<std::function<void()>> _jobs;
+            /** Mutex protecting the job queue */
+            std::mutex _jobMutex;
+            /** Signaled when a job is queued or the loader is destroyed */
+            std::condition_variable _jobCondition;
+            /** Whether the loader is being destroyed */
+            bool _stopping;
 
-            /** Returns a pointer to the classes creator object. */
-            const Creator* getCreator(const std::string& className) {
+            /** Queues a job for the background thread, starting it if necessary */
+            std::future<void> enqueue(std::function<void()> job) {
+                std::shared_ptr<std::packaged_task<void()>> task = std::make_shared<std::packaged_task<void()>>(job);
+                std::future<void> result = task->get_future();
+
+                {
+                    std::lock_guard<std::mutex> lock(_jobMutex);
+                    _jobs.push_back([task]() { (*task)(); });
+                    if (!_worker.joinable())
+                        _worker = std::thread(&class_loader::runJobs, this);
+                }
+                _jobCondition.notify_one();
+
+                return result;
+            }
+
+            /** Background thread main loop, runs until the loader is destroyed and all jobs are done */
+            void runJobs() {
+                std::unique_lock<std::mutex> lock(_jobMutex);
+                for (;;) {
+                    _jobCondition.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+                    if (_jobs.empty())
+                        return;
+
+                    std::function<void()> job = std::move(_jobs.front());
+                    _jobs.pop_front();
+
+                    lock.unlock();
+                    job();
+                    lock.lock();
+                }
+            }
+
+            /**
+             * Replaces the current snapshot, the loader mutex has to be held.
+             *
+             * The old snapshot is retired to the epoch_domain, it is freed once the read sections that may
+             * use it are done and no snapshotPtr references it anymore.
+             */
+            void publish(const snapshotPtr& next) {
+                snapshotPtr old = std::move(_owner);
+                _owner = next;
+                _head.store(next.get(), std::memory_order_seq_cst);
+                _generation.fetch_add(1, std::memory_order_release);
+                epoch_domain::global().retire(std::move(old));
+            }
+
+            /** Returns the current snapshot, only valid inside an epoch_guard, ordered after entering it. */
+            const snapshot* head() const {
+                return _head.load(std::memory_order_seq_cst);
+            }
+
+            /** Creates an object without arguments. */
+            template <typename... Args>
+            static B* createWith(const Creator* cre, std::true_type) {
+                return cre->acquire();
+            }
+
+            /** Creates an object through the creator exported for the argument types. */
+            template <typename... Args>
+            static B* createWith(const Creator* cre, std::false_type, Args&&... args) {
+                return factoryCreatorArgs<B, Args...>::cast(cre)->create(std::forward<Args>(args)...);
+            }
+
+            /** Constructs an object in storage without arguments. */
+            template <typename... Args>
+            static B* constructWith(const Creator* cre, void* storage, std::true_type) {
+                return cre->construct(storage);
+            }
+
+            /** Constructs an object in storage through the creator exported for the argument types. */
+            template <typename... Args>
+            static B* constructWith(const Creator* cre, void* storage, std::false_type, Args&&... args) {
+                return factoryCreatorArgs<B, Args...>::cast(cre)->construct(storage, std::forward<Args>(args)...);
+            }
+
+            /** Returns the index entry for a class through the thread cache if enabled, valid inside an epoch_guard. */
+            const classInfo& find(string_ref className) const {
+                if (_caching.load(std::memory_order_relaxed))
+                    return cachedLookup(className);
+
+                const snapshot* snap = head();
+                return lookup(snap, className);
+            }
+
+            /** Returns the index entry for a class from the cache of the calling thread, valid inside an epoch_guard. */
+            const classInfo& cachedLookup(string_ref className) const {
+                threadCache& cache = threadCache::local();
+
+                // read the generation first, a concurrent change results in an early refresh
+                std::uint64_t generation = _generation.load(std::memory_order_acquire);
+                if (cache.loader != _id || cache.generation != generation)
+                    cache.reset(_id, generation, current());
+
+                auto it = cache.classes.find(className);
+                if (it != cache.classes.end()) {
+                    touch(*it->second->pInfo);
+                    return *it->second;
+                }
+
+                const snapshot* snap = cache.snap.get();
+                const classInfo& ci = lookup(snap, className);
+                if (snap != cache.snap.get()) {
+                    // the class was loaded on demand, the entries cached so far belong to the old snapshot
+                    cache.reset(0, 0, snap->shared_from_this());
+                    return ci;
+                }
+
+                auto key = snap->classes.find(className);
+                cache.classes.insert(std::make_pair(key->first, &ci));
+                return ci;
+            }
+
+            /**
+             * Returns the index entry for a class, throws if it cannot be created.
+             *
+             * Classes of libraries registered by load_lazy are loaded on the slow path, snap is replaced
+             * by the snapshot containing them. Has to be called inside an epoch_guard.
+             */
+            const classInfo& lookup(const snapshot*& snap, string_ref className) const {
+                auto it = snap->classes.find(className);
+                if (it != snap->classes.end()) {
+                    touch(*it->second.pInfo);
+                    return it->second;
+                }
+
+                auto lazy = snap->lazy.find(className);
+                if (lazy != snap->lazy.end()) {
+                    if (lazy->second->error)
+                        std::rethrow_exception(lazy->second->error);
+
+                    // loading on demand doesn't change the set of classes that can be created
+                    const_cast<class_loader*>(this)->materialize(className);
+
+                    snap = head();
+                    it = snap->classes.find(className);
+                    if (it != snap->classes.end())
+                        return it->second;
+                }
+
+                throw libraryCreateException();
+            }
+
+            /** Loads the lazily registered library providing a class, unless another thread did already. */
+            void materialize(string_ref className) {
                 std::lock_guard<std::mutex> lock(mutex);
+                snapshotPtr snap = current();
+                if (snap->classes.find(className) != snap->classes.end())
+                    return;
+
+                auto it = snap->lazy.find(className);
+                if (it == snap->lazy.end())
+                    return;
 
-                // iterate available libraries
-                for (auto &it: _map) {
-                    auto itm = it.second.pFactory->find(className);
-                    if (itm != it.second.pFactory->end())
-                        return *itm;
+                std::shared_ptr<const lazyInfo> info = it->second;
+                if (info->error)
+                    std::rethrow_exception(info->error);
+
+                std::uint64_t first = _order + 1;
+                try {
+                    loadLocked(info->path, info->flags, info->refCount, info.get());
+                } catch (...) {
+                    // keep the registration for unload, its classes fail with the same error from now on
+                    std::shared_ptr<lazyInfo> failed = std::make_shared<lazyInfo>(*info);
+                    failed->error = std::current_exception();
+
+                    std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*current());
+                    dropLazy(*next, info->path);
+                    addLazy(*next, failed);
+                    publish(next);
+                    throw;
                 }
 
-                // return NULL if class could not be found
+                // a module refusing to build is not retried on every create
+                snap = current();
+                if (snap->lazy.find(className) != snap->lazy.end()) {
+                    std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*snap);
+                    dropLazy(*next, info->path);
+                    publish(next);
+                }
+
+                evictLocked(first);
+            }
+
+            /**
+             * Loads a library, the loader mutex has to be held.
+             *
+             * Libraries of a bundle are written out from the lazy registration given or found for the path,
+             * the references of a registration found are added to refCount.
+             */
+            void loadLocked(string_ref path, int flags, int refCount = 1, const lazyInfo* source = nullptr) {
+                snapshotPtr snap = current();
+
+                // check if library has already been loaded
+                auto it = snap->libraries.find(path);
+                if (it == snap->libraries.end()) {
+                    std::shared_ptr<const lazyInfo> registered;
+                    if (source == nullptr && !snap->lazy.empty()) {
+                        registered = findLazy(*snap, path);
+                        source = registered.get();
+
+                        // registered and evicted libraries keep the references they had while unloaded
+                        if (registered)
+                            refCount += registered->refCount;
+                    }
+
+                    std::shared_ptr<libraryInfo> li = openFrom(path, ++_order, flags, source);
+                    if (!li)
+                        return;
+
+                    li->refCount = refCount;
+
+                    // publish a copy containing the new library
+                    std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*snap);
+                    addLibrary(*next, li);
+                    publish(next);
+                } else {
+                    // increase reference count if library was already loaded
+                    ++it->second->refCount;
+                }
+            }
+
+            /**
+             * Opens a library like openLibrary, libraries of a bundle are written out from source first.
+             *
+             * Doesn't touch the published state, the loader mutex doesn't have to be held.
+             */
+            std::shared_ptr<libraryInfo> openFrom(string_ref path, std::uint64_t order, int flags, const lazyInfo* source) const {
+                if (source == nullptr || !source->bundle)
+                    return openLibrary(path, order, string_ref(), flags);
+
+                std::unique_ptr<bundle_file> extracted(new bundle_file(*source->bundle, source->member, shared_library::suffix()));
+                std::shared_ptr<libraryInfo> li = openLibrary(path, order, extracted->path(), flags | shared_library::SHLIB_EXACT_PATH_IMPL);
+                if (!li)
+                    return li;
+
+                li->flags = flags;
+                li->bundle = source->bundle;
+                li->member = source->member;
+                li->extracted = std::move(extracted);
+                return li;
+            }
+
+            /**
+             * Evicts idle libraries until the budget is met, libraries loaded at or after the given position
+             * in load order are kept. Returns the number of evicted libraries, the loader mutex has to be held.
+             */
+            std::size_t evictLocked(std::uint64_t keep) {
+                if (!_eviction.enabled())
+                    return 0;
+
+                snapshotPtr snap = current();
+                std::size_t count = snap->libraries.size();
+                std::size_t bytes = 0;
+                for (auto &it : snap->libraries) {
+                    bytes += it.second->mappedBytes;
+                }
+
+                if (!_eviction.exceeded(count, bytes))
+                    return 0;
+
+                // least recently used first
+                const std::int64_t now = ticks();
+                const std::int64_t idle = std::chrono::duration_cast<std::chrono::nanoseconds>(_eviction.idle).count();
+                std::vector<const libraryInfo*> candidates;
+                for (auto &it : snap->libraries) {
+                    const libraryInfo& li = *it.second;
+                    if (li.order < keep && li.live.load(std::memory_order_acquire) == 0 && !li.pinned.load(std::memory_order_relaxed) &&
+                        now - li.lastUse.load(std::memory_order_relaxed) >= idle)
+                        candidates.push_back(&li);
+                }
+                std::sort(candidates.begin(), candidates.end(), [](const libraryInfo* a, const libraryInfo* b) {
+                    return a->lastUse.load(std::memory_order_relaxed) < b->lastUse.load(std::memory_order_relaxed);
+                });
+
+                std::shared_ptr<snapshot> next = std::make_shared<snapshot>(*snap);
+                std::size_t evicted = 0;
+                for (auto li : candidates) {
+                    if (!_eviction.exceeded(count, bytes))
+                        break;
+
+                    // register the classes to load the library again on demand
+                    std::shared_ptr<lazyInfo> info = registration(*li);
+
+                    unindexLibrary(*next, *li);
+                    next->libraries.erase(string_ref(li->path));
+                    addLazy(*next, info);
+
+                    --count;
+                    bytes -= li->mappedBytes;
+                    ++evicted;
+                }
+
+                if (evicted != 0)
+                    publish(next);
+                return evicted;
+            }
+
+            /** Returns the current time in clock ticks, used for eviction. */
+            static std::int64_t ticks() {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+            }
+
+            /**
+             * Records the use of a library while eviction is enabled, writes at most once per millisecond.
+             *
+             * The clock is read when a thread uses another library than before and every MODULEPP_TOUCH_SAMPLE
+             * uses of the same one.
+             */
+            void touch(const libraryInfo& li) const {
+                if (!_tracking.load(std::memory_order_relaxed))
+                    return;
+
+                struct sampler {
+                    const libraryInfo* last;
+                    unsigned uses;
+                };
+
+                static thread_local sampler sample = { nullptr, 0 };
+                if (sample.last == &li && ++sample.uses < MODULEPP_TOUCH_SAMPLE)
+                    return;
+
+                sample.last = &li;
+                sample.uses = 0;
+
+                std::int64_t now = ticks();
+                if (now - li.lastUse.load(std::memory_order_relaxed) >= 1000000)
+                    li.lastUse.store(now, std::memory_order_relaxed);
+            }
+
+            /** Keeps a library from being evicted, used for instances nothing tracks. */
+            static void pin(const libraryInfo& li) {
+                if (!li.pinned.load(std::memory_order_relaxed))
+                    li.pinned.store(true, std::memory_order_relaxed);
+            }
+
+            /** Returns a registration loading a library again on demand, with its current reference count. */
+            static std::shared_ptr<lazyInfo> registration(const libraryInfo& li) {
+                std::shared_ptr<lazyInfo> info = std::make_shared<lazyInfo>();
+                info->path = li.path;
+                info->flags = li.flags;
+                info->refCount = li.refCount;
+                info->bundle = li.bundle;
+                info->member = li.member;
+                forEachClass(li, [&info](string_ref name, const Creator*) {
+                    info->classes.push_back(name.str());
+                });
+                return info;
+            }
+
+            /** Adds the classes of a lazily registered library to s. */
+            static void addLazy(snapshot& s, const std::shared_ptr<const lazyInfo>& info) {
+                for (auto &name : info->classes) {
+                    s.lazy[string_ref(name)] = info;
+                }
+            }
+
+            /** Returns the lazy registration of a library in s, or nullptr. */
+            static std::shared_ptr<const lazyInfo> findLazy(const snapshot& s, string_ref path) {
+                for (auto &it : s.lazy) {
+                    if (string_ref(it.second->path) == path)
+                        return it.second;
+                }
                 return nullptr;
             }
 
-            /** Returns a pointer to the factory for the given library */
-            const Factory* getFactory(const std::string& path) {
-                std::lock_guard<std::mutex> lock(mutex);
+            /** Removes the lazy registration of a library from s, returns whether there was one. */
+            static bool dropLazy(snapshot& s, string_ref path) {
+                bool dropped = false;
+                for (auto it = s.lazy.begin(); it != s.lazy.end();) {
+                    if (string_ref(it->second->path) == path) {
+                        it = s.lazy.erase(it);
+                        dropped = true;
+                    } else {
+                        ++it;
+                    }
+                }
+                return dropped;
+            }
+
+            /** Clock used for observer timings. */
+            typedef std::chrono::steady_clock clock;
+
+            /** Returns a new loader id, ids start at 1. */
+            static std::uint64_t nextId() {
+                static std::atomic<std::uint64_t> ids(0);
+                return ids.fetch_add(1, std::memory_order_relaxed) + 1;
+            }
+
+            /** Returns the current time, or nothing if the observer is disabled. */
+            static clock::time_point now() {
+                return O::enabled ? clock::now() : clock::time_point();
+            }
+
+            /** Returns the time passed since start. */
+            static std::chrono::nanoseconds since(clock::time_point start) {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+            }
+
+            /** Creates an object of a class using make, timing it if the observer is enabled and counting it if statistics are. */
+            template <typename F>
+            B* observeCreate(const classInfo& ci, string_ref className, F make) const {
+                B* b;
+                if (!O::enabled) {
+                    b = make();
+                } else {
+                    clock::time_point start = clock::now();
+                    b = make();
+                    _observer.classCreated(className, since(start));
+                }
+
+                if (_counting.load(std::memory_order_relaxed))
+                    ci.pInfo->counters->created(ci.slot);
+                return b;
+            }
+
+            /** Returns the slot destructions of a class are counted in, uncounted while statistics are disabled. */
+            std::size_t countedSlot(const classInfo& ci) const {
+                return _counting.load(std::memory_order_relaxed) ? ci.slot : uncounted();
+            }
+
+            /** Slot value of instances whose destruction isn't counted. */
+            static constexpr std::size_t uncounted() {
+                return std::numeric_limits<std::size_t>::max();
+            }
+
+            /** Returns a lifecycle symbol of a library or nullptr if it doesn't exist. */
+            template <typename F>
+            F lifecycleSymbol(libraryInfo& li, const char* name) const {
+                clock::time_point start = now();
+                F symbol = li.pLibrary->template findSymbol<F>(name);
+                if (O::enabled)
+                    _observer.symbolResolved(li.path, name, since(start));
 
-                // check map for factory
-                auto it = _map.find(path);
-                if (it != _map.end()) {
-                    return it->second.pFactory;
+                return symbol;
+            }
+
+            /**
+             * Opens, initializes and builds a library, returns nullptr if the module refused to build.
+             *
+             * Libraries exporting a manifest are used as they are, their classes are never registered.
+             */
+            std::shared_ptr<libraryInfo> openLibrary(string_ref path, std::uint64_t order, string_ref file = string_ref(), int flags = 0) const {
+                // create info struct for library, freed by its destructor in case of errors
+                std::shared_ptr<libraryInfo> li = std::make_shared<libraryInfo>();
+                li->path = path.str();
+
+                // taken first, a build deployed while opening shows up as a change
+                if (file.size() == 0)
+                    li->stamped = library_image::fileStamp(li->path + shared_library::suffix(), li->stamp);
+
+                clock::time_point opened = clock::now();
+                clock::time_point start = now();
+                if (_registry) {
+                    li->module = _registry->open(file.size() ? file.str() : li->path, flags);
+                    li->pLibrary = &li->module->library();
                 } else {
+                    li->pLibrary = new shared_library();
+                    li->pLibrary->load(file.size() ? file.str() : li->path, flags);
+                }
+                if (O::enabled)
+                    _observer.libraryOpened(li->path, since(start));
+
+                li->refCount = 1;
+                li->order = order;
+                li->flags = flags;
+                li->mappedBytes = li->pLibrary->mappedSize();
+                li->lastUse.store(ticks(), std::memory_order_relaxed);
+
+                // resolve all entry points once
+                InitializeLibraryFunc initializeLibrary = lifecycleSymbol<InitializeLibraryFunc>(*li, "initializeLibrary");
+                const manifestHeader* manifest = lifecycleSymbol<const manifestHeader*>(*li, "moduleManifest");
+                BuildFactoryFunc buildManifest = nullptr;
+                if (manifest != nullptr) {
+                    if (manifest->magic != MANIFEST_MAGIC || manifest->version != FACTORY_ABI_VERSION ||
+                        manifest->entrySize != sizeof(manifestEntry) || manifest->fingerprint != fingerprint_of<B>())
+                        throw libraryManifestException();
+
+                    li->pManifest = lifecycleSymbol<const manifestEntry*>(*li, "moduleManifestEntries");
+                    if (li->pManifest == nullptr)
+                        throw librarySymbolMissingException();
+                    li->manifestSize = manifest->count;
+                } else {
+                    buildManifest = lifecycleSymbol<BuildFactoryFunc>(*li, "buildFactory");
+                }
+                li->uninitialize = lifecycleSymbol<UninitializeLibraryFunc>(*li, "uninitializeLibrary");
+
+                if (li->module) {
+                    start = now();
+                    if (li->module->initialize(initializeLibrary, li->uninitialize) && O::enabled)
+                        _observer.libraryInitialized(li->path, since(start));
+                } else if (initializeLibrary != nullptr) {
+                    start = now();
+                    initializeLibrary();
+                    if (O::enabled)
+                        _observer.libraryInitialized(li->path, since(start));
+                }
+
+                // build (required unless there is a manifest)
+                if (li->pManifest != nullptr) {
+                    li->initialized = true;
+                    if (O::enabled)
+                        _observer.factoryBuilt(li->path, li->manifestSize, std::chrono::nanoseconds(0));
+                } else if (buildManifest != nullptr && li->module) {
+                    // built once per base class and module, later loaders reuse it
+                    start = now();
+                    li->pFactory = li->module->template build<B>(buildManifest);
+                    if (li->pFactory == nullptr)
+                        return nullptr;
+                    if (O::enabled)
+                        _observer.factoryBuilt(li->path, li->pFactory->size(), since(start));
+
+                    li->initialized = true;
+                } else if (buildManifest != nullptr) {
+                    li->pFactory = new Factory();
+
+                    start = now();
+                    bool built = buildManifest(const_cast<Factory*>(li->pFactory));
+                    if (O::enabled)
+                        _observer.factoryBuilt(li->path, li->pFactory->size(), since(start));
+
+                    if (!built)
+                        return nullptr;
+
+                    li->initialized = true;
+                } else {
+                    throw librarySymbolMissingException();
+                }
+
+                li->counters.reset(new class_counters(li->pManifest != nullptr ? li->manifestSize : li->pFactory->size()));
+                li->loadTime = since(opened);
+                return li;
+            }
+
+            /** Copies a file, throws libraryReloadException on failure. */
+            static void copyFile(const std::string& from, const std::string& to) {
+                std::ifstream in(from.c_str(), std::ios::binary);
+                std::ofstream out(to.c_str(), std::ios::binary | std::ios::trunc);
+                if (!in || !out || !(out << in.rdbuf()) || !out.flush()) {
+                    out.close();
+                    std::remove(to.c_str());
+                    throw libraryReloadException();
+                }
+            }
+
+            /** Adds an opened library to s, throws if its classes conflict with the index. */
+            void addLibrary(snapshot& s, const std::shared_ptr<libraryInfo>& li) const {
+                if (_policy == CONFLICT_THROW) {
+                    forEachClass(*li, [&s](string_ref name, const Creator*) {
+                        if (s.classes.find(name) != s.classes.end())
+                            throw libraryConflictException();
+                    });
+                }
+
+                s.libraries[string_ref(li->path)] = li;
+                indexLibrary(s, *li);
+                if (!s.lazy.empty())
+                    dropLazy(s, li->path);
+            }
+
+            /** Hands a new instance to a smart pointer referencing its library. */
+            instance_ptr track(const classInfo& ci, B* b, arena* a) const {
+                ci.pInfo->live.fetch_add(1, std::memory_order_relaxed);
+                return instance_ptr(b, deleter(ci.pCreator, ci.pInfo->shared_from_this(), a, countedSlot(ci)));
+            }
+
+            /** Returns true if a should provide a class instead of b. */
+            bool preferred(const libraryInfo& a, const libraryInfo& b) const {
+                return (_policy == CONFLICT_REPLACE) ? (a.order > b.order) : (a.order < b.order);
+            }
+
+            /** Calls f(name, creator) for every class exported by a library, names reference the library. */
+            template <typename F>
+            static void forEachClass(const libraryInfo& li, F f) {
+                if (li.pManifest != nullptr) {
+                    for (std::size_t i = 0; i < li.manifestSize; ++i) {
+                        f(string_ref(li.pManifest[i].name), static_cast<const Creator*>(li.pManifest[i].creator));
+                    }
+                } else {
+                    for (auto it = li.pFactory->begin(); it != li.pFactory->end(); ++it) {
+                        f(string_ref(it.id()), *it);
+                    }
+                }
+            }
+
+            /**
+             * Returns the creator a library exports under name or nullptr.
+             *
+             * key is set to the name referencing the library and slot to the position of the class in forEachClass order.
+             */
+            static const Creator* findClass(const libraryInfo& li, string_ref name, string_ref& key, std::size_t& slot) {
+                if (li.pManifest != nullptr) {
+                    const manifestEntry* entry = manifest_find(li.pManifest, li.manifestSize, name);
+                    if (entry == nullptr)
+                        return nullptr;
+
+                    key = string_ref(entry->name, name.size());
+                    slot = static_cast<std::size_t>(entry - li.pManifest);
+                    return static_cast<const Creator*>(entry->creator);
+                }
+
+                auto it = li.pFactory->find(name);
+                if (it == li.pFactory->end())
                     return nullptr;
+
+                key = string_ref(it.id());
+                slot = 0;
+                for (auto c = li.pFactory->begin(); c != it; ++c) {
+                    ++slot;
                 }
+                return *it;
+            }
+
+            /** Adds all classes of a library to the index of s. */
+            void indexLibrary(snapshot& s, const libraryInfo& li) const {
+                std::size_t slot = 0;
+                forEachClass(li, [&](string_ref name, const Creator* creator) {
+                    auto itc = s.classes.find(name);
+                    if (itc == s.classes.end()) {
+                        s.classes[name] = classInfo{creator, &li, slot};
+                    } else if (preferred(li, *itc->second.pInfo)) {
+                        // re-insert, the key has to reference the new provider
+                        s.classes.erase(itc);
+                        s.classes[name] = classInfo{creator, &li, slot};
+                    }
+                    ++slot;
+                });
+            }
+
+            /** Removes all classes of a library from the index of s, promoting shadowed exports. */
+            void unindexLibrary(snapshot& s, const libraryInfo& li) const {
+                forEachClass(li, [&](string_ref name, const Creator*) {
+                    auto itc = s.classes.find(name);
+                    if (itc == s.classes.end() || itc->second.pInfo != &li)
+                        return;
+
+                    // look for another library exporting the same name
+                    classInfo replacement{nullptr, nullptr, 0};
+                    string_ref key;
+                    for (auto &itl : s.libraries) {
+                        const libraryInfo& other = *itl.second;
+                        if (&other == &li || (replacement.pInfo && !preferred(other, *replacement.pInfo)))
+                            continue;
+
+                        string_ref otherKey;
+                        std::size_t slot;
+                        const Creator* creator = findClass(other, name, otherKey, slot);
+                        if (creator != nullptr) {
+                            replacement = classInfo{creator, &other, slot};
+                            key = otherKey;
+                        }
+                    }
+
+                    // the key references li and has to be replaced as well
+                    s.classes.erase(itc);
+                    if (replacement.pInfo)
+                        s.classes[key] = replacement;
+                });
             }
     };
 }
 
-#endif	/* _MODULEPP_MODULE_LIBRARY_HPP_ */
\ No newline at end of file
+#endif	/* _MODULEPP_MODULE_LIBRARY_HPP_ */
@@ -69,6 +69,62 @@ namespace modulepp {
                 return "Error loading class: load symbol missing from library.";
             }
     };
+
+    /** Exception thrown when a library cannot be copied for reloading. */
+    class libraryReloadException : public std::exception {
+        public:
+            virtual const char* what() const throw() {
+                return "Error reloading library: cannot create copy of the new build.";
+            }
+    };
+
+    /** Exception thrown when a directory cannot be searched for libraries. */
+    class libraryDirectoryException : public std::exception {
+        public:
+            virtual const char* what() const throw() {
+                return "Error listing libraries: directory cannot be opened.";
+            }
+    };
+
+    /** Exception thrown when a library exports a class name that is already provided by another library */
+    class libraryConflictException : public std::exception {
+        public:
+            virtual const char* what() const throw() {
+                return "Error loading library: class already exported by another library.";
+            }
+    };
+
+    /** Exception thrown when the manifest of a library was built for a different base class or modulepp version */
+    class libraryManifestException : public std::exception {
+        public:
+            virtual const char* what() const throw() {
+                return "Error loading library: manifest does not match the base class.";
+            }
+    };
+
+    /** Exception thrown when a library file cannot be read or exports no manifest */
+    class libraryProbeException : public std::exception {
+        public:
+            virtual const char* what() const throw() {
+                return "Error probing library: file not readable or without manifest.";
+            }
+    };
+
+    /** Exception thrown when a bundle cannot be read, written or extracted */
+    class libraryBundleException : public std::exception {
+        public:
+            virtual const char* what() const throw() {
+                return "Error handling bundle: file not readable, malformed or not writable.";
+            }
+    };
+
+    /** Exception thrown when a shared library is opened with flags other than the ones it is already open with */
+    class libraryFlagsException : public std::exception {
+        public:
+            virtual const char* what() const throw() {
+                return "Error loading library: already open with different flags.";
+            }
+    };
 }
 
 #endif /* _MODULEPP_MODULE_LIBRARY_EXCEPTION_HPP_ */
\ No newline at end of file
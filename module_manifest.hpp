@@ -0,0 +1,137 @@
+/**
+ * @file module_manifest.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_MANIFEST_HPP_
+#define _MODULEPP_MODULE_MANIFEST_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "module_string.hpp"
+#include "module_factory.hpp"
+#include "module_fingerprint.hpp"
+
+namespace modulepp {
+    /** Identifies a manifest header, "MPPM" */
+    static const std::uint32_t MANIFEST_MAGIC = 0x4d50504d;
+
+    /** Space reserved for class names in manifest entries, including the terminator */
+    static const std::size_t MANIFEST_NAME_SIZE = 64;
+
+    /**
+     * Class exported through a static manifest.
+     *
+     * Entries live in the read-only data of the module and don't depend on the base class, so they
+     * can be inspected without knowing it. Names are stored inline to be readable from the file.
+     */
+    struct manifestEntry {
+        /** Name of the class, null-terminated */
+        char name[MANIFEST_NAME_SIZE];
+        /** hash_name of the name */
+        std::uint64_t hash;
+        /** sizeof the class */
+        std::uint32_t size;
+        /** alignof the class */
+        std::uint32_t alignment;
+        /** Statically allocated factoryCreator of the base class */
+        const void* creator;
+        /** Returns a new instance as pointer to the base class */
+        void* (*create)();
+        /** Deletes an instance returned by create */
+        void (*destroy)(void*);
+    };
+
+    /** Header of a manifest, exported as moduleManifest next to the entries in moduleManifestEntries. */
+    struct manifestHeader {
+        /** MANIFEST_MAGIC */
+        std::uint32_t magic;
+        /** FACTORY_ABI_VERSION the module was built with */
+        std::uint32_t version;
+        /** fingerprint_of the base class */
+        std::uint64_t fingerprint;
+        /** Number of entries */
+        std::uint32_t count;
+        /** sizeof(manifestEntry) of the module */
+        std::uint32_t entrySize;
+    };
+
+    /** Creates a C for manifest entries */
+    template <typename B, typename C>
+    void* manifestCreate() {
+        return static_cast<B*>(new C);
+    }
+
+    /** Deletes a C created by manifestCreate */
+    template <typename B, typename C>
+    void manifestDestroy(void* b) {
+        delete static_cast<B*>(b);
+    }
+
+    /** Compile-time strcmp. */
+    constexpr int manifest_compare(const char* a, const char* b) {
+        return (*a != *b || *a == '\0') ? (static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b)) : manifest_compare(a + 1, b + 1);
+    }
+
+    /** Returns whether the n entries are sorted by name without duplicates, usable at compile-time. */
+    constexpr bool manifest_sorted(const manifestEntry* entries, std::size_t n) {
+        return (n < 2) ? true : (manifest_compare(entries[0].name, entries[1].name) < 0 && manifest_sorted(entries + 1, n - 1));
+    }
+
+    /** Compares a name against the name of an entry, strcmp-like. */
+    inline int manifest_compare(string_ref name, const manifestEntry& entry) {
+        for (std::size_t i = 0; i < name.size(); ++i) {
+            unsigned char a = static_cast<unsigned char>(name.data()[i]);
+            unsigned char b = static_cast<unsigned char>(entry.name[i]);
+            if (a != b || b == '\0')
+                return a - b;
+        }
+        return -static_cast<unsigned char>(entry.name[name.size()]);
+    }
+
+    /** Binary search for a name in n sorted entries, returns nullptr if it isn't exported. */
+    inline const manifestEntry* manifest_find(const manifestEntry* entries, std::size_t n, string_ref name) {
+        if (name.size() >= MANIFEST_NAME_SIZE)
+            return nullptr;
+
+        std::size_t first = 0;
+        while (n > 0) {
+            std::size_t half = n / 2;
+            int cmp = manifest_compare(name, entries[first + half]);
+            if (cmp == 0)
+                return &entries[first + half];
+
+            if (cmp > 0) {
+                first += half + 1;
+                n -= half + 1;
+            } else {
+                n = half;
+            }
+        }
+        return nullptr;
+    }
+}
+
+#endif /* _MODULEPP_MODULE_MANIFEST_HPP_ */
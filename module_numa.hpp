@@ -0,0 +1,159 @@
+/**
+ * @file module_numa.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_NUMA_HPP_
+#define _MODULEPP_MODULE_NUMA_HPP_
+
+#include <new>
+#include <string>
+#include <fstream>
+#include <cstdlib>
+#include <cstddef>
+
+#if defined(_WIN32)
+    #include <Windows.h>
+#else
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #if defined(__linux__)
+        #include <sys/syscall.h>
+    #endif
+#endif
+
+/** Maximum number of NUMA nodes told apart, higher nodes share the pools of lower ones. */
+#ifndef MODULEPP_NUMA_NODES
+    #define MODULEPP_NUMA_NODES 8
+#endif
+
+/** Number of numa_node calls a thread answers from its cached node before querying it again. */
+#ifndef MODULEPP_NUMA_REFRESH
+    #define MODULEPP_NUMA_REFRESH 256
+#endif
+
+namespace modulepp {
+    /** Returns the number of NUMA nodes of the system, at most MODULEPP_NUMA_NODES and 1 if unknown. */
+    inline unsigned numa_nodes() {
+        static const unsigned count = []() -> unsigned {
+            unsigned long highest = 0;
+            #if defined(_WIN32)
+                ULONG node = 0;
+                if (GetNumaHighestNodeNumber(&node))
+                    highest = node;
+            #elif defined(__linux__)
+                // a list of ranges like "0-3" or "0,2-3", the last number is the highest node
+                std::ifstream in("/sys/devices/system/node/possible");
+                std::string nodes;
+                if (std::getline(in, nodes) && !nodes.empty()) {
+                    std::string::size_type last = nodes.find_last_of("-,");
+                    highest = std::strtoul(nodes.c_str() + (last == std::string::npos ? 0 : last + 1), nullptr, 10);
+                }
+            #endif
+            return (highest < MODULEPP_NUMA_NODES) ? static_cast<unsigned>(highest) + 1 : MODULEPP_NUMA_NODES;
+        }();
+        return count;
+    }
+
+    /** Returns the NUMA node of the processor the calling thread runs on, 0 if unknown. */
+    inline unsigned numa_current_node() {
+        #if defined(_WIN32)
+            PROCESSOR_NUMBER processor;
+            USHORT node = 0;
+            GetCurrentProcessorNumberEx(&processor);
+            if (GetNumaProcessorNodeEx(&processor, &node))
+                return node;
+        #elif defined(__linux__) && defined(SYS_getcpu)
+            unsigned cpu = 0, node = 0;
+            if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+                return node;
+        #endif
+        return 0;
+    }
+
+    /**
+     * Returns the NUMA node of the calling thread.
+     *
+     * The node is cached per thread and queried again every MODULEPP_NUMA_REFRESH calls, so a thread
+     * that migrated to another node is served from its old node for a while.
+     */
+    inline unsigned numa_node() {
+        struct cachedNode {
+            unsigned node;
+            unsigned calls;
+        };
+
+        static thread_local cachedNode cached = { numa_current_node(), 0 };
+        if (++cached.calls >= MODULEPP_NUMA_REFRESH) {
+            cached.node = numa_current_node();
+            cached.calls = 0;
+        }
+        return cached.node;
+    }
+
+    /**
+     * Returns page aligned storage preferably backed by memory of the given node, throws std::bad_alloc.
+     *
+     * Where memory cannot be bound to a node, pages are placed by the operating system, usually on the
+     * node of the thread touching them first.
+     */
+    inline void* numa_allocate(std::size_t size, unsigned node) {
+        #if defined(_WIN32)
+            void* p = VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+            if (p == nullptr)
+                p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            if (p == nullptr)
+                throw std::bad_alloc();
+            return p;
+        #else
+            void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::bad_alloc();
+
+            #if defined(__linux__) && defined(SYS_mbind)
+                // MPOL_PREFERRED, falls back to other nodes once the node is exhausted
+                unsigned long mask = 0;
+                if (node < sizeof(mask) * 8) {
+                    mask = 1UL << node;
+                    syscall(SYS_mbind, p, size, 1, &mask, sizeof(mask) * 8 + 1, 0);
+                }
+            #else
+                (void) node;
+            #endif
+            return p;
+        #endif
+    }
+
+    /** Returns storage obtained from numa_allocate */
+    inline void numa_deallocate(void* p, std::size_t size) {
+        #if defined(_WIN32)
+            (void) size;
+            VirtualFree(p, 0, MEM_RELEASE);
+        #else
+            munmap(p, size);
+        #endif
+    }
+}
+
+#endif /* _MODULEPP_MODULE_NUMA_HPP_ */
@@ -0,0 +1,105 @@
+/**
+ * @file module_observer.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_OBSERVER_HPP_
+#define _MODULEPP_MODULE_OBSERVER_HPP_
+
+#include <chrono>
+#include <cstddef>
+
+#include "module_string.hpp"
+
+/**
+ * Short usage example:
+ *
+ * struct MyObserver : public modulepp::load_observer {
+ *     void libraryOpened(modulepp::string_ref path, std::chrono::nanoseconds time) { ... }
+ * };
+ *
+ * modulepp::class_loader<MyBaseClass, MyObserver> loader;
+ **/
+
+namespace modulepp {
+    /**
+     * Default class_loader observer, disables all instrumentation.
+     *
+     * Observers are used as the second template parameter of class_loader. When enabled is false the
+     * loader does not read the clock and the calls below compile to nothing.
+     */
+    class null_observer {
+        public:
+            /** whether the loader reports to this observer */
+            static const bool enabled = false;
+
+            /** called after the library was opened by the operating system */
+            void libraryOpened(string_ref, std::chrono::nanoseconds) {}
+            /** called after a lifecycle symbol was looked up */
+            void symbolResolved(string_ref, string_ref, std::chrono::nanoseconds) {}
+            /** called after initializeLibrary returned */
+            void libraryInitialized(string_ref, std::chrono::nanoseconds) {}
+            /** called after buildFactory returned with the number of classes exported */
+            void factoryBuilt(string_ref, std::size_t, std::chrono::nanoseconds) {}
+            /** called after an instance of a class was created, once per block for create_many */
+            void classCreated(string_ref, std::chrono::nanoseconds) {}
+    };
+
+    /**
+     * Observer interface to derive from for instrumenting a class_loader.
+     *
+     * Functions may be called concurrently from any thread using or loading into the loader.
+     */
+    class load_observer {
+        public:
+            /** whether the loader reports to this observer */
+            static const bool enabled = true;
+
+            /** destructor */
+            virtual ~load_observer() {}
+
+            /** called after the library was opened by the operating system */
+            virtual void libraryOpened(string_ref path, std::chrono::nanoseconds time) {
+                (void) path; (void) time;
+            }
+            /** called after a lifecycle symbol was looked up */
+            virtual void symbolResolved(string_ref path, string_ref symbol, std::chrono::nanoseconds time) {
+                (void) path; (void) symbol; (void) time;
+            }
+            /** called after initializeLibrary returned */
+            virtual void libraryInitialized(string_ref path, std::chrono::nanoseconds time) {
+                (void) path; (void) time;
+            }
+            /** called after buildFactory returned with the number of classes exported */
+            virtual void factoryBuilt(string_ref path, std::size_t classes, std::chrono::nanoseconds time) {
+                (void) path; (void) classes; (void) time;
+            }
+            /** called after an instance of a class was created, once per block for create_many */
+            virtual void classCreated(string_ref className, std::chrono::nanoseconds time) {
+                (void) className; (void) time;
+            }
+    };
+}
+
+#endif /* _MODULEPP_MODULE_OBSERVER_HPP_ */
@@ -0,0 +1,474 @@
+/**
+ * @file module_pool.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_POOL_HPP_
+#define _MODULEPP_MODULE_POOL_HPP_
+
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "module_numa.hpp"
+
+/** Maximum number of recycled objects kept per class, node and thread. */
+#ifndef MODULEPP_POOL_CAPACITY
+    #define MODULEPP_POOL_CAPACITY 1024
+#endif
+
+/** Number of objects node_pool moves between a thread and the shared list of a node at once. */
+#ifndef MODULEPP_POOL_BATCH
+    #define MODULEPP_POOL_BATCH 32
+#endif
+
+/** Bytes node_pool allocates from a node at once, chunks hold at least one object. */
+#ifndef MODULEPP_NODE_POOL_CHUNK
+    #define MODULEPP_NODE_POOL_CHUNK 65536
+#endif
+
+/** Number of independently locked shards of an object_registry. */
+#ifndef MODULEPP_REGISTRY_SHARDS
+    #define MODULEPP_REGISTRY_SHARDS 16
+#endif
+
+namespace modulepp {
+    /** Caller supplied memory source objects can be created in. */
+    class arena {
+        public:
+            /** destructor */
+            virtual ~arena() {}
+            /** returns storage for an object of the given size and alignment */
+            virtual void* allocate(std::size_t size, std::size_t alignment) = 0;
+            /** returns storage obtained from allocate */
+            virtual void deallocate(void* p, std::size_t size, std::size_t alignment) = 0;
+    };
+
+    /** Arena handing out consecutive parts of a fixed buffer, storage is reclaimed all at once by the owner. */
+    class monotonic_arena : public arena {
+        public:
+            /** constructor, buffer has to outlive the arena and all objects created in it */
+            monotonic_arena(void* buffer, std::size_t size)
+                : _begin(static_cast<char*>(buffer)), _end(_begin + size), _pos(_begin) {}
+
+            /** destructor */
+            virtual ~monotonic_arena() {}
+
+            /** returns the next suitably aligned part of the buffer, throws std::bad_alloc if exhausted */
+            void* allocate(std::size_t size, std::size_t alignment) {
+                std::uintptr_t pos = reinterpret_cast<std::uintptr_t>(_pos);
+                std::uintptr_t aligned = (pos + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1);
+                std::size_t padding = static_cast<std::size_t>(aligned - pos);
+
+                if (padding > static_cast<std::size_t>(_end - _pos) || size > static_cast<std::size_t>(_end - _pos) - padding)
+                    throw std::bad_alloc();
+
+                _pos += padding + size;
+                return reinterpret_cast<void*>(aligned);
+            }
+
+            /** storage is only reclaimed by reset() */
+            void deallocate(void*, std::size_t, std::size_t) {}
+
+            /** makes the whole buffer available again, all objects have to be destroyed */
+            void reset() {
+                _pos = _begin;
+            }
+
+            /** returns number of bytes handed out */
+            std::size_t used() const {
+                return static_cast<std::size_t>(_pos - _begin);
+            }
+        private:
+            /** start of the buffer */
+            char* _begin;
+            /** end of the buffer */
+            char* _end;
+            /** next free byte */
+            char* _pos;
+
+            /** noncopyable */
+            monotonic_arena(const monotonic_arena&) = delete;
+    };
+
+    /**
+     * Storage for objects of type C kept per NUMA node.
+     *
+     * Storage is carved from chunks bound to the node it is allocated for and returns to that node when
+     * released, whichever thread releases it. Each thread keeps a private list per node and exchanges
+     * MODULEPP_POOL_BATCH slots at a time with the shared list of the node, so only one in a batch of
+     * allocations or releases takes a lock. Chunks whose storage is all free are returned to the system,
+     * except for one per node, the remaining chunks are freed together with the module defining C.
+     */
+    template <typename C>
+    class node_pool {
+        public:
+            /** returns storage for one object of type C on the node of the calling thread, see numa_node */
+            static void* allocate() {
+                return allocate(numa_node());
+            }
+
+            /** returns storage for one object of type C on the given node, nodes are folded into MODULEPP_NUMA_NODES */
+            static void* allocate(unsigned node) {
+                node %= MODULEPP_NUMA_NODES;
+                slotList& l = local().lists[node];
+                if (l.head == nullptr)
+                    shared(node).take(node, l);
+
+                slot* s = l.head;
+                l.head = s->next;
+                --l.count;
+                return reinterpret_cast<char*>(s) + OFFSET;
+            }
+
+            /** returns storage obtained from allocate to the node it was allocated on */
+            static void deallocate(void* p) {
+                slot* s = slotOf(p);
+                unsigned node = s->owner->node;
+                slotList& l = local().lists[node];
+                s->next = l.head;
+                l.head = s;
+                if (++l.count > MODULEPP_POOL_CAPACITY)
+                    shared(node).give(l, MODULEPP_POOL_BATCH);
+            }
+
+            /** returns the node storage obtained from allocate belongs to */
+            static unsigned node_of(const void* p) {
+                return slotOf(const_cast<void*>(p))->owner->node;
+            }
+        private:
+            struct chunk;
+
+            /** header in front of every object, links free storage */
+            struct slot {
+                slot* next;
+                chunk* owner;
+            };
+
+            /** storage carved from a node at once, linked to the other chunks of the node */
+            struct chunk {
+                chunk* prev;
+                chunk* next;
+                /** free slots of the chunk */
+                slot* free;
+                /** slots handed out to threads */
+                std::size_t used;
+                /** node the storage is bound to */
+                unsigned node;
+            };
+
+            /** alignment of slots and chunk contents */
+            static const std::size_t ALIGN = (alignof(C) > alignof(slot)) ? alignof(C) : alignof(slot);
+            /** distance from the slot to the object */
+            static const std::size_t OFFSET = (sizeof(slot) + alignof(C) - 1) / alignof(C) * alignof(C);
+            /** distance between slots */
+            static const std::size_t STRIDE = (OFFSET + sizeof(C) + ALIGN - 1) / ALIGN * ALIGN;
+            /** distance from the chunk to its first slot */
+            static const std::size_t HEADER = (sizeof(chunk) + ALIGN - 1) / ALIGN * ALIGN;
+            /** size of a chunk */
+            static const std::size_t CHUNK = (MODULEPP_NODE_POOL_CHUNK > HEADER + STRIDE) ? MODULEPP_NODE_POOL_CHUNK : HEADER + STRIDE;
+
+            /** list of free slots */
+            struct slotList {
+                slot* head;
+                std::size_t count;
+
+                slotList() : head(nullptr), count(0) {}
+            };
+
+            /** doubly linked list of chunks */
+            struct chunkList {
+                chunk* head;
+
+                chunkList() : head(nullptr) {}
+
+                /** frees all chunks */
+                ~chunkList() {
+                    while (head != nullptr) {
+                        chunk* c = head;
+                        head = c->next;
+                        numa_deallocate(c, CHUNK);
+                    }
+                }
+
+                void push(chunk* c) {
+                    c->prev = nullptr;
+                    c->next = head;
+                    if (head != nullptr)
+                        head->prev = c;
+                    head = c;
+                }
+
+                void erase(chunk* c) {
+                    if (c->prev != nullptr)
+                        c->prev->next = c->next;
+                    else
+                        head = c->next;
+                    if (c->next != nullptr)
+                        c->next->prev = c->prev;
+                }
+            };
+
+            /** chunks of a node shared by all threads, full ones are kept apart so taking slots never searches */
+            struct alignas(64) nodeList {
+                std::mutex mutex;
+                /** chunks with free slots */
+                chunkList partial;
+                /** chunks with all slots handed out */
+                chunkList full;
+                /** chunks without slots handed out, at most one is kept */
+                std::size_t empty;
+
+                nodeList() : empty(0) {}
+
+                /** moves up to MODULEPP_POOL_BATCH free slots to l, carving a new chunk if there are none */
+                void take(unsigned node, slotList& l) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (partial.head == nullptr)
+                        carve(node);
+
+                    for (std::size_t n = 0; n < MODULEPP_POOL_BATCH && partial.head != nullptr; ++n) {
+                        chunk* c = partial.head;
+                        if (c->used++ == 0)
+                            --empty;
+
+                        slot* s = c->free;
+                        c->free = s->next;
+                        s->next = l.head;
+                        l.head = s;
+                        ++l.count;
+
+                        if (c->free == nullptr) {
+                            partial.erase(c);
+                            full.push(c);
+                        }
+                    }
+                }
+
+                /** moves up to n slots from l back to their chunks, frees chunks becoming empty beyond the first */
+                void give(slotList& l, std::size_t n) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (; n != 0 && l.head != nullptr; --n) {
+                        slot* s = l.head;
+                        l.head = s->next;
+                        --l.count;
+
+                        chunk* c = s->owner;
+                        if (c->free == nullptr) {
+                            full.erase(c);
+                            partial.push(c);
+                        }
+                        s->next = c->free;
+                        c->free = s;
+
+                        if (--c->used == 0 && empty++ != 0) {
+                            --empty;
+                            partial.erase(c);
+                            numa_deallocate(c, CHUNK);
+                        }
+                    }
+                }
+
+                /** allocates a chunk on the node and links its slots */
+                void carve(unsigned node) {
+                    chunk* c = static_cast<chunk*>(numa_allocate(CHUNK, node));
+                    c->free = nullptr;
+                    c->used = 0;
+                    c->node = node;
+                    for (std::size_t pos = HEADER; pos + STRIDE <= CHUNK; pos += STRIDE) {
+                        slot* s = reinterpret_cast<slot*>(reinterpret_cast<char*>(c) + pos);
+                        s->owner = c;
+                        s->next = c->free;
+                        c->free = s;
+                    }
+                    partial.push(c);
+                    ++empty;
+                }
+            };
+
+            /** free storage a thread keeps per node */
+            struct threadLists {
+                slotList lists[MODULEPP_NUMA_NODES];
+
+                ~threadLists() {
+                    for (unsigned node = 0; node < MODULEPP_NUMA_NODES; ++node) {
+                        if (lists[node].head != nullptr)
+                            shared(node).give(lists[node], lists[node].count);
+                    }
+                }
+            };
+
+            /** returns the shared list of a node */
+            static nodeList& shared(unsigned node) {
+                static nodeList lists[MODULEPP_NUMA_NODES];
+                return lists[node];
+            }
+
+            /** returns the lists of the calling thread */
+            static threadLists& local() {
+                static thread_local threadLists l;
+                return l;
+            }
+
+            /** returns the slot of storage obtained from allocate */
+            static slot* slotOf(void* p) {
+                return reinterpret_cast<slot*>(static_cast<char*>(p) - OFFSET);
+            }
+
+            static_assert(alignof(C) <= 4096, "Pooled classes cannot be aligned beyond a page.");
+    };
+
+    /** Returns the shard index of the calling thread, threads are distributed round-robin. */
+    inline unsigned registry_shard() {
+        static std::atomic<unsigned> next(0);
+        static thread_local unsigned shard = next.fetch_add(1, std::memory_order_relaxed) % MODULEPP_REGISTRY_SHARDS;
+        return shard;
+    }
+
+    /**
+     * Thread-safe registry owning objects of type C until they are released.
+     *
+     * Each object is allocated together with an intrusive list node, so tracking costs no extra
+     * allocation and releasing is O(1). Objects are linked into the shard of the creating thread,
+     * threads only contend on a shard when they share it or release objects of another shard.
+     */
+    template <typename C>
+    class object_registry {
+        public:
+            /** constructor */
+            object_registry() {
+                for (unsigned i = 0; i < MODULEPP_REGISTRY_SHARDS; ++i) {
+                    _shards[i].head.prev = _shards[i].head.next = &_shards[i].head;
+                    _shards[i].head.shard = i;
+                }
+            }
+
+            /** destructor, destroys all objects still registered */
+            ~object_registry() {
+                clear();
+            }
+
+            /** returns a newly constructed, registered object */
+            C* create() {
+                void* storage = ::operator new(OFFSET + sizeof(C));
+                C* c;
+                try {
+                    c = new (static_cast<char*>(storage) + OFFSET) C;
+                } catch (...) {
+                    ::operator delete(storage);
+                    throw;
+                }
+
+                node* n = static_cast<node*>(storage);
+                n->shard = registry_shard();
+
+                shard& s = _shards[n->shard];
+                std::lock_guard<std::mutex> lock(s.mutex);
+                n->prev = &s.head;
+                n->next = s.head.next;
+                s.head.next->prev = n;
+                s.head.next = n;
+                return c;
+            }
+
+            /** destroys an object obtained from create */
+            void release(C* c) {
+                node* n = nodeOf(c);
+                {
+                    std::lock_guard<std::mutex> lock(_shards[n->shard].mutex);
+                    n->prev->next = n->next;
+                    n->next->prev = n->prev;
+                }
+
+                c->~C();
+                ::operator delete(n);
+            }
+
+            /** destroys all registered objects */
+            void clear() {
+                for (unsigned i = 0; i < MODULEPP_REGISTRY_SHARDS; ++i) {
+                    shard& s = _shards[i];
+                    node list;
+                    {
+                        // detach the list so destructors run without holding the lock
+                        std::lock_guard<std::mutex> lock(s.mutex);
+                        if (s.head.next == &s.head)
+                            continue;
+
+                        list.next = s.head.next;
+                        list.prev = s.head.prev;
+                        s.head.prev = s.head.next = &s.head;
+                    }
+
+                    list.prev->next = nullptr;
+                    for (node* n = list.next; n != nullptr;) {
+                        node* next = n->next;
+                        objectOf(n)->~C();
+                        ::operator delete(n);
+                        n = next;
+                    }
+                }
+            }
+        private:
+            /** list node stored in front of each object */
+            struct node {
+                node* prev;
+                node* next;
+                unsigned shard;
+            };
+
+            /** list of objects created by threads of the same shard */
+            struct shard {
+                std::mutex mutex;
+                node head;
+                /** keeps neighbouring shards on separate cache lines */
+                char padding[64];
+            };
+
+            /** distance from the node to the object */
+            static const std::size_t OFFSET = (sizeof(node) + alignof(C) - 1) / alignof(C) * alignof(C);
+
+            /** shards of the registry */
+            shard _shards[MODULEPP_REGISTRY_SHARDS];
+
+            /** returns the node of an object */
+            static node* nodeOf(C* c) {
+                return reinterpret_cast<node*>(reinterpret_cast<char*>(c) - OFFSET);
+            }
+
+            /** returns the object of a node */
+            static C* objectOf(node* n) {
+                return reinterpret_cast<C*>(reinterpret_cast<char*>(n) + OFFSET);
+            }
+
+            /** noncopyable */
+            object_registry(const object_registry&) = delete;
+
+            static_assert(alignof(C) <= alignof(std::max_align_t), "Tracked classes cannot be over-aligned.");
+    };
+}
+
+#endif /* _MODULEPP_MODULE_POOL_HPP_ */
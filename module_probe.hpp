@@ -0,0 +1,110 @@
+/**
+ * @file module_probe.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_PROBE_HPP_
+#define _MODULEPP_MODULE_PROBE_HPP_
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "module_library_exceptions.hpp"
+#include "module_manifest.hpp"
+
+#if defined(__LINUX__) || defined(__APPLE__) || defined(hpux) || defined(_hpux) || defined(__GNUC__)
+    #include "module_probe_unix.hpp"
+    #define LIBRARY_IMAGE_IMPLEMENTATION library_image_unix
+#elif defined(_WIN32)
+    #include "module_probe_win32.hpp"
+    #define LIBRARY_IMAGE_IMPLEMENTATION library_image_win32
+#else
+    static_assert( false, "No viable library image implementation found." );
+#endif
+
+namespace modulepp {
+    /** Typedef for the operating-system specific library file reader. */
+    typedef LIBRARY_IMAGE_IMPLEMENTATION library_image;
+
+    /** Contents of the manifest of a library that has not been loaded. */
+    struct library_metadata {
+        /** Path of the library */
+        std::string path;
+        /** FACTORY_ABI_VERSION the library was built with */
+        std::uint32_t version;
+        /** Fingerprint of the base class the library was built for */
+        std::uint64_t fingerprint;
+        /** Whether the manifest can be used by this build, class_loader::probe also checks the base class */
+        bool compatible;
+        /** Names of the exported classes, sorted */
+        std::vector<std::string> classes;
+
+        /** Constructor */
+        library_metadata() : version(0), fingerprint(0), compatible(false) {}
+    };
+
+    /**
+     * Reads the manifest of a library file, including the suffix, without loading it.
+     *
+     * Neither initializers nor constructors of the library run. Throws libraryProbeException if the file
+     * is not readable or doesn't export a manifest.
+     */
+    inline library_metadata probe_library(const std::string& file) {
+        library_image image;
+        image.open(file);
+
+        const manifestHeader* header = static_cast<const manifestHeader*>(image.findSymbol("moduleManifest", sizeof(manifestHeader)));
+        if (header == nullptr || header->magic != MANIFEST_MAGIC || header->entrySize < offsetof(manifestEntry, creator))
+            throw libraryProbeException();
+
+        const unsigned char* entries = static_cast<const unsigned char*>(
+            image.findSymbol("moduleManifestEntries", std::size_t(header->count) * header->entrySize));
+        if (entries == nullptr)
+            throw libraryProbeException();
+
+        library_metadata result;
+        result.path = file;
+        result.version = header->version;
+        result.fingerprint = header->fingerprint;
+        result.compatible = (header->version == FACTORY_ABI_VERSION && header->entrySize == sizeof(manifestEntry));
+
+        // names lead every entry, also for entries of a different layout
+        result.classes.reserve(header->count);
+        for (std::uint32_t i = 0; i < header->count; ++i) {
+            const char* name = reinterpret_cast<const char*>(entries + std::size_t(i) * header->entrySize);
+            const void* end = std::memchr(name, '\0', MANIFEST_NAME_SIZE);
+            if (end == nullptr)
+                throw libraryProbeException();
+
+            result.classes.push_back(std::string(name, static_cast<const char*>(end)));
+        }
+
+        return result;
+    }
+}
+
+#endif /* _MODULEPP_MODULE_PROBE_HPP_ */
@@ -0,0 +1,232 @@
+/**
+ * @file module_probe_unix.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_PROBE_UNIX_HPP_
+#define _MODULEPP_MODULE_PROBE_UNIX_HPP_
+#if defined(__LINUX__) || defined(__APPLE__) || defined(hpux) || defined(_hpux) || defined(__GNUC__)
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if !defined(__APPLE__)
+    #include <elf.h>
+    #define MODULEPP_PROBE_ELF
+#endif
+
+#include "module_library_exceptions.hpp"
+
+namespace modulepp {
+    /**
+     * Read-only mapping of a shared library file, used to read exported data without loading it.
+     *
+     * Only ELF files in the byte order of the host are understood, other formats have no exports.
+     */
+    class library_image_unix {
+        public:
+            /** Constructor */
+            library_image_unix() : data(nullptr), length(0) {}
+
+            /** Destructor */
+            ~library_image_unix() {
+                close();
+            }
+
+            /** Modification stamp of a file. */
+            struct stamp {
+                /** Modification time in nanoseconds */
+                std::uint64_t mtime;
+                /** Size in bytes */
+                std::uint64_t size;
+
+                inline bool operator == (const stamp& s) const {
+                    return (mtime == s.mtime) && (size == s.size);
+                }
+
+                inline bool operator != (const stamp& s) const {
+                    return !(*this == s);
+                }
+            };
+
+            /** Reads the stamp of a file, returns false if it doesn't exist. */
+            static bool fileStamp(const std::string& file, stamp& s) {
+                struct ::stat st;
+                if (::stat(file.c_str(), &st) != 0) {
+                    return false;
+                }
+
+                #if defined(__APPLE__)
+                    s.mtime = static_cast<std::uint64_t>(st.st_mtimespec.tv_sec) * 1000000000ULL + st.st_mtimespec.tv_nsec;
+                #elif defined(__linux__)
+                    s.mtime = static_cast<std::uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec;
+                #else
+                    s.mtime = static_cast<std::uint64_t>(st.st_mtime) * 1000000000ULL;
+                #endif
+                s.size = static_cast<std::uint64_t>(st.st_size);
+                return true;
+            }
+
+            /** Maps the file at the given path, including the suffix */
+            void open(const std::string& path) {
+                close();
+
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    throw libraryProbeException();
+                }
+
+                struct stat st;
+                if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+                    ::close(fd);
+                    throw libraryProbeException();
+                }
+
+                void* mapping = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (mapping == MAP_FAILED) {
+                    throw libraryProbeException();
+                }
+
+                data = static_cast<const unsigned char*>(mapping);
+                length = static_cast<std::size_t>(st.st_size);
+            }
+
+            /** Unmaps the file */
+            void close() {
+                if (data != nullptr) {
+                    munmap(const_cast<unsigned char*>(data), length);
+                    data = nullptr;
+                    length = 0;
+                }
+            }
+
+            /** Returns the contents of the mapped file */
+            const unsigned char* bytes() const {
+                return data;
+            }
+
+            /** Returns the size of the mapped file */
+            std::size_t size() const {
+                return length;
+            }
+
+            /**
+             * Returns the initial contents of an exported object, nullptr if there is none of at least size bytes.
+             *
+             * Pointers in the object are not relocated.
+             */
+            const void* findSymbol(const char* name, std::size_t size) const {
+                #ifdef MODULEPP_PROBE_ELF
+                    if (length < EI_NIDENT || std::memcmp(data, ELFMAG, SELFMAG) != 0 || data[EI_DATA] != nativeEncoding())
+                        return nullptr;
+
+                    if (data[EI_CLASS] == ELFCLASS64)
+                        return findElfSymbol<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(name, size);
+                    if (data[EI_CLASS] == ELFCLASS32)
+                        return findElfSymbol<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(name, size);
+                #else
+                    (void) name;
+                    (void) size;
+                #endif
+                return nullptr;
+            }
+        private:
+            /** Mapped file */
+            const unsigned char* data;
+            /** Size of the file */
+            std::size_t length;
+
+            /** Returns whether the range lies within the file */
+            bool contains(std::uint64_t offset, std::uint64_t size) const {
+                return offset <= length && size <= length - offset;
+            }
+
+            #ifdef MODULEPP_PROBE_ELF
+            /** Returns the ELF data encoding of the host */
+            static unsigned char nativeEncoding() {
+                const std::uint16_t one = 1;
+                return (*reinterpret_cast<const unsigned char*>(&one) == 1) ? ELFDATA2LSB : ELFDATA2MSB;
+            }
+
+            /** Looks the symbol up in the dynamic symbol table */
+            template <typename Ehdr, typename Shdr, typename Sym>
+            const void* findElfSymbol(const char* name, std::size_t size) const {
+                if (!contains(0, sizeof(Ehdr)))
+                    return nullptr;
+
+                const Ehdr* header = reinterpret_cast<const Ehdr*>(data);
+                if (header->e_shentsize != sizeof(Shdr) || !contains(header->e_shoff, std::uint64_t(header->e_shnum) * sizeof(Shdr)))
+                    return nullptr;
+
+                const Shdr* sections = reinterpret_cast<const Shdr*>(data + header->e_shoff);
+                for (std::size_t i = 0; i < header->e_shnum; ++i) {
+                    const Shdr& symbols = sections[i];
+                    if (symbols.sh_type != SHT_DYNSYM || symbols.sh_entsize != sizeof(Sym) || symbols.sh_link >= header->e_shnum)
+                        continue;
+
+                    const Shdr& strings = sections[symbols.sh_link];
+                    if (!contains(symbols.sh_offset, symbols.sh_size) || !contains(strings.sh_offset, strings.sh_size))
+                        return nullptr;
+
+                    const Sym* sym = reinterpret_cast<const Sym*>(data + symbols.sh_offset);
+                    const char* names = reinterpret_cast<const char*>(data + strings.sh_offset);
+                    const std::size_t nameLength = std::strlen(name);
+
+                    for (std::size_t j = 0; j < symbols.sh_size / sizeof(Sym); ++j) {
+                        if (sym[j].st_name + std::uint64_t(nameLength) >= strings.sh_size ||
+                            std::memcmp(names + sym[j].st_name, name, nameLength + 1) != 0)
+                            continue;
+
+                        // the symbol has to be defined in a section with contents in the file
+                        if (sym[j].st_shndx == SHN_UNDEF || sym[j].st_shndx >= header->e_shnum || sym[j].st_size < size)
+                            return nullptr;
+
+                        const Shdr& section = sections[sym[j].st_shndx];
+                        if (section.sh_type == SHT_NOBITS || sym[j].st_value < section.sh_addr ||
+                            sym[j].st_value - section.sh_addr + size > section.sh_size)
+                            return nullptr;
+
+                        std::uint64_t offset = section.sh_offset + (sym[j].st_value - section.sh_addr);
+                        return contains(offset, size) ? data + offset : nullptr;
+                    }
+                }
+
+                return nullptr;
+            }
+            #endif
+
+            /** Non-Copyable */
+            library_image_unix(const library_image_unix&) = delete;
+    };
+};
+
+#endif  /* defined(__LINUX__) || defined(__APPLE__) || defined(hpux) || defined(_hpux) || defined(__GNUC__) */
+#endif  /* _MODULEPP_MODULE_PROBE_UNIX_HPP_ */
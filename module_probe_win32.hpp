@@ -0,0 +1,230 @@
+/**
+ * @file module_probe_win32.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_PROBE_WIN32_HPP_
+#define _MODULEPP_MODULE_PROBE_WIN32_HPP_
+#ifdef _WIN32
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <Windows.h>
+
+#include "module_library_exceptions.hpp"
+
+namespace modulepp {
+    /** Read-only mapping of a dll file, used to read exported data without loading it. */
+    class library_image_win32 {
+        public:
+            /** Constructor */
+            library_image_win32() : data(nullptr), length(0) {}
+
+            /** Destructor */
+            ~library_image_win32() {
+                close();
+            }
+
+            /** Modification stamp of a file. */
+            struct stamp {
+                /** Modification time in 100 nanosecond intervals */
+                std::uint64_t mtime;
+                /** Size in bytes */
+                std::uint64_t size;
+
+                inline bool operator == (const stamp& s) const {
+                    return (mtime == s.mtime) && (size == s.size);
+                }
+
+                inline bool operator != (const stamp& s) const {
+                    return !(*this == s);
+                }
+            };
+
+            /** Reads the stamp of a file, returns false if it doesn't exist. */
+            static bool fileStamp(const std::string& file, stamp& s) {
+                WIN32_FILE_ATTRIBUTE_DATA data;
+                if (!GetFileAttributesExA(file.c_str(), GetFileExInfoStandard, &data)) {
+                    return false;
+                }
+
+                s.mtime = (static_cast<std::uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+                s.size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+                return true;
+            }
+
+            /** Maps the file at the given path, including the suffix */
+            void open(const std::string& path) {
+                close();
+
+                HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (file == INVALID_HANDLE_VALUE) {
+                    throw libraryProbeException();
+                }
+
+                LARGE_INTEGER size;
+                if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0) {
+                    CloseHandle(file);
+                    throw libraryProbeException();
+                }
+
+                HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                CloseHandle(file);
+                if (mapping == nullptr) {
+                    throw libraryProbeException();
+                }
+
+                void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+                if (view == nullptr) {
+                    throw libraryProbeException();
+                }
+
+                data = static_cast<const unsigned char*>(view);
+                length = static_cast<std::size_t>(size.QuadPart);
+            }
+
+            /** Unmaps the file */
+            void close() {
+                if (data != nullptr) {
+                    UnmapViewOfFile(data);
+                    data = nullptr;
+                    length = 0;
+                }
+            }
+
+            /** Returns the contents of the mapped file */
+            const unsigned char* bytes() const {
+                return data;
+            }
+
+            /** Returns the size of the mapped file */
+            std::size_t size() const {
+                return length;
+            }
+
+            /**
+             * Returns the initial contents of an exported object, nullptr if there is none of at least size bytes.
+             *
+             * Pointers in the object are not relocated.
+             */
+            const void* findSymbol(const char* name, std::size_t size) const {
+                if (!contains(0, sizeof(IMAGE_DOS_HEADER)))
+                    return nullptr;
+
+                const IMAGE_DOS_HEADER* dos = reinterpret_cast<const IMAGE_DOS_HEADER*>(data);
+                if (dos->e_magic != IMAGE_DOS_SIGNATURE || dos->e_lfanew < 0 || !contains(dos->e_lfanew, sizeof(IMAGE_NT_HEADERS32)))
+                    return nullptr;
+
+                const IMAGE_NT_HEADERS32* nt = reinterpret_cast<const IMAGE_NT_HEADERS32*>(data + dos->e_lfanew);
+                if (nt->Signature != IMAGE_NT_SIGNATURE)
+                    return nullptr;
+
+                if (nt->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+                    return findExport<IMAGE_NT_HEADERS64>(dos->e_lfanew, name, size);
+                if (nt->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+                    return findExport<IMAGE_NT_HEADERS32>(dos->e_lfanew, name, size);
+                return nullptr;
+            }
+        private:
+            /** Mapped file */
+            const unsigned char* data;
+            /** Size of the file */
+            std::size_t length;
+
+            /** Returns whether the range lies within the file */
+            bool contains(std::uint64_t offset, std::uint64_t size) const {
+                return offset <= length && size <= length - offset;
+            }
+
+            /** Translates a relative virtual address to a file offset of size bytes, returns false if it has no file contents */
+            bool offsetOf(const IMAGE_SECTION_HEADER* sections, std::size_t count, DWORD rva, std::size_t size, std::uint64_t& offset) const {
+                for (std::size_t i = 0; i < count; ++i) {
+                    const IMAGE_SECTION_HEADER& section = sections[i];
+                    if (rva >= section.VirtualAddress && std::uint64_t(rva - section.VirtualAddress) + size <= section.SizeOfRawData) {
+                        offset = section.PointerToRawData + std::uint64_t(rva - section.VirtualAddress);
+                        return contains(offset, size);
+                    }
+                }
+                return false;
+            }
+
+            /** Looks the symbol up in the export directory */
+            template <typename Headers>
+            const void* findExport(LONG ntOffset, const char* name, std::size_t size) const {
+                if (!contains(ntOffset, sizeof(Headers)))
+                    return nullptr;
+
+                const Headers* nt = reinterpret_cast<const Headers*>(data + ntOffset);
+                if (nt->OptionalHeader.NumberOfRvaAndSizes <= IMAGE_DIRECTORY_ENTRY_EXPORT)
+                    return nullptr;
+
+                const IMAGE_SECTION_HEADER* sections = IMAGE_FIRST_SECTION(nt);
+                const std::size_t count = nt->FileHeader.NumberOfSections;
+                if (!contains(reinterpret_cast<const unsigned char*>(sections) - data, count * sizeof(IMAGE_SECTION_HEADER)))
+                    return nullptr;
+
+                std::uint64_t offset = 0;
+                const IMAGE_DATA_DIRECTORY& directory = nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+                if (directory.VirtualAddress == 0 || !offsetOf(sections, count, directory.VirtualAddress, sizeof(IMAGE_EXPORT_DIRECTORY), offset))
+                    return nullptr;
+
+                const IMAGE_EXPORT_DIRECTORY* exports = reinterpret_cast<const IMAGE_EXPORT_DIRECTORY*>(data + offset);
+                std::uint64_t namesOffset = 0, ordinalsOffset = 0, functionsOffset = 0;
+                if (!offsetOf(sections, count, exports->AddressOfNames, exports->NumberOfNames * sizeof(DWORD), namesOffset) ||
+                    !offsetOf(sections, count, exports->AddressOfNameOrdinals, exports->NumberOfNames * sizeof(WORD), ordinalsOffset) ||
+                    !offsetOf(sections, count, exports->AddressOfFunctions, exports->NumberOfFunctions * sizeof(DWORD), functionsOffset))
+                    return nullptr;
+
+                const DWORD* names = reinterpret_cast<const DWORD*>(data + namesOffset);
+                const WORD* ordinals = reinterpret_cast<const WORD*>(data + ordinalsOffset);
+                const DWORD* functions = reinterpret_cast<const DWORD*>(data + functionsOffset);
+                const std::size_t nameLength = std::strlen(name);
+
+                for (DWORD i = 0; i < exports->NumberOfNames; ++i) {
+                    std::uint64_t nameOffset = 0;
+                    if (!offsetOf(sections, count, names[i], nameLength + 1, nameOffset) ||
+                        std::memcmp(data + nameOffset, name, nameLength + 1) != 0)
+                        continue;
+
+                    if (ordinals[i] >= exports->NumberOfFunctions)
+                        return nullptr;
+
+                    std::uint64_t symbolOffset = 0;
+                    return offsetOf(sections, count, functions[ordinals[i]], size, symbolOffset) ? data + symbolOffset : nullptr;
+                }
+
+                return nullptr;
+            }
+
+            /** Non-Copyable */
+            library_image_win32(const library_image_win32&) = delete;
+    };
+};
+
+#endif  /* _WIN32 */
+#endif  /* _MODULEPP_MODULE_PROBE_WIN32_HPP_ */
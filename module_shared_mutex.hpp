@@ -0,0 +1,163 @@
+/**
+ * @file module_shared_mutex.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_SHARED_MUTEX_HPP_
+#define _MODULEPP_MODULE_SHARED_MUTEX_HPP_
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+    #include <shared_mutex>
+    #define MODULEPP_SHARED_MUTEX_STD
+#elif defined(_WIN32)
+    #include <Windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+#include <system_error>
+
+namespace modulepp {
+    /**
+     * Reader/writer mutex, any number of readers or a single writer may hold it.
+     *
+     * Maps onto std::shared_mutex where available, a SRWLOCK on windows and a pthread_rwlock_t
+     * preferring writers otherwise. Meets the Lockable requirements, so std::lock_guard takes
+     * it exclusively and shared_lock_guard shared.
+     */
+    class shared_mutex {
+        public:
+            /** constructor */
+            shared_mutex() {
+                #if defined(MODULEPP_SHARED_MUTEX_STD)
+                #elif defined(_WIN32)
+                    InitializeSRWLock(&_lock);
+                #else
+                    pthread_rwlockattr_t attr;
+                    pthread_rwlockattr_init(&attr);
+                    #if defined(__GLIBC__) && defined(_GNU_SOURCE)
+                        // glibc prefers readers by default, which starves unload under heavy lookups
+                        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+                    #endif
+                    int error = pthread_rwlock_init(&_lock, &attr);
+                    pthread_rwlockattr_destroy(&attr);
+                    if (error != 0)
+                        throw std::system_error(error, std::system_category());
+                #endif
+            }
+
+            /** destructor */
+            ~shared_mutex() {
+                #if !defined(MODULEPP_SHARED_MUTEX_STD) && !defined(_WIN32)
+                    pthread_rwlock_destroy(&_lock);
+                #endif
+            }
+
+            /** acquires exclusive ownership */
+            void lock() {
+                #if defined(MODULEPP_SHARED_MUTEX_STD)
+                    _lock.lock();
+                #elif defined(_WIN32)
+                    AcquireSRWLockExclusive(&_lock);
+                #else
+                    int error = pthread_rwlock_wrlock(&_lock);
+                    if (error != 0)
+                        throw std::system_error(error, std::system_category());
+                #endif
+            }
+
+            /** releases exclusive ownership */
+            void unlock() {
+                #if defined(MODULEPP_SHARED_MUTEX_STD)
+                    _lock.unlock();
+                #elif defined(_WIN32)
+                    ReleaseSRWLockExclusive(&_lock);
+                #else
+                    pthread_rwlock_unlock(&_lock);
+                #endif
+            }
+
+            /** acquires shared ownership */
+            void lock_shared() {
+                #if defined(MODULEPP_SHARED_MUTEX_STD)
+                    _lock.lock_shared();
+                #elif defined(_WIN32)
+                    AcquireSRWLockShared(&_lock);
+                #else
+                    int error = pthread_rwlock_rdlock(&_lock);
+                    if (error != 0)
+                        throw std::system_error(error, std::system_category());
+                #endif
+            }
+
+            /** releases shared ownership */
+            void unlock_shared() {
+                #if defined(MODULEPP_SHARED_MUTEX_STD)
+                    _lock.unlock_shared();
+                #elif defined(_WIN32)
+                    ReleaseSRWLockShared(&_lock);
+                #else
+                    pthread_rwlock_unlock(&_lock);
+                #endif
+            }
+        private:
+            /** underlying lock */
+            #if defined(MODULEPP_SHARED_MUTEX_STD)
+                std::shared_mutex _lock;
+            #elif defined(_WIN32)
+                SRWLOCK _lock;
+            #else
+                pthread_rwlock_t _lock;
+            #endif
+
+            /** noncopyable */
+            shared_mutex(const shared_mutex&) = delete;
+            /** noncopyable */
+            shared_mutex& operator = (const shared_mutex&) = delete;
+    };
+
+    /** Holds shared ownership of a shared_mutex for its lifetime, the shared counterpart of std::lock_guard. */
+    class shared_lock_guard {
+        public:
+            /** constructor, acquires shared ownership */
+            explicit shared_lock_guard(shared_mutex& m) : _mutex(m) {
+                _mutex.lock_shared();
+            }
+
+            /** destructor, releases shared ownership */
+            ~shared_lock_guard() {
+                _mutex.unlock_shared();
+            }
+        private:
+            /** mutex held */
+            shared_mutex& _mutex;
+
+            /** noncopyable */
+            shared_lock_guard(const shared_lock_guard&) = delete;
+            /** noncopyable */
+            shared_lock_guard& operator = (const shared_lock_guard&) = delete;
+    };
+}
+
+#endif	/* _MODULEPP_MODULE_SHARED_MUTEX_HPP_ */
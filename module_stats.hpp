@@ -0,0 +1,211 @@
+/**
+ * @file module_stats.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_STATS_HPP_
+#define _MODULEPP_MODULE_STATS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** Number of stripes per library counters are spread over, threads are assigned to them round-robin. */
+#ifndef MODULEPP_STATS_STRIPES
+    #define MODULEPP_STATS_STRIPES 8
+#endif
+
+namespace modulepp {
+    /**
+     * Creates and destroys of the classes of one library, counted with relaxed atomics.
+     *
+     * Every stripe holds counters for all classes and starts on its own cache line, so threads
+     * counting on different stripes never share a line. Reading sums up all stripes.
+     */
+    class class_counters {
+        public:
+            /** constructor, counts the given number of classes */
+            explicit class_counters(std::size_t classes)
+                : _stride(((classes * sizeof(counter) + CACHE_LINE - 1) / CACHE_LINE) * (CACHE_LINE / sizeof(counter))),
+                  _storage(new counter[_stride * MODULEPP_STATS_STRIPES + CACHE_LINE / sizeof(counter)]())
+            {
+                // operator new only guarantees fundamental alignment, align the first stripe by hand
+                std::uintptr_t raw = reinterpret_cast<std::uintptr_t>(_storage.get());
+                _first = _storage.get() + ((CACHE_LINE - raw % CACHE_LINE) % CACHE_LINE) / sizeof(counter);
+            }
+
+            /** counts instances of a class created */
+            void created(std::size_t cls, std::uint64_t n = 1) {
+                local(cls).creates.fetch_add(n, std::memory_order_relaxed);
+            }
+
+            /** counts instances of a class destroyed */
+            void destroyed(std::size_t cls, std::uint64_t n = 1) {
+                local(cls).destroys.fetch_add(n, std::memory_order_relaxed);
+            }
+
+            /** returns the number of instances of a class created */
+            std::uint64_t creates(std::size_t cls) const {
+                std::uint64_t result = 0;
+                for (std::size_t s = 0; s < MODULEPP_STATS_STRIPES; ++s) {
+                    result += _first[s * _stride + cls].creates.load(std::memory_order_relaxed);
+                }
+                return result;
+            }
+
+            /** returns the number of instances of a class destroyed */
+            std::uint64_t destroys(std::size_t cls) const {
+                std::uint64_t result = 0;
+                for (std::size_t s = 0; s < MODULEPP_STATS_STRIPES; ++s) {
+                    result += _first[s * _stride + cls].destroys.load(std::memory_order_relaxed);
+                }
+                return result;
+            }
+        private:
+            /** assumed size of a cache line */
+            static constexpr std::size_t CACHE_LINE = 64;
+
+            /** counters of one class in one stripe */
+            struct counter {
+                std::atomic<std::uint64_t> creates;
+                std::atomic<std::uint64_t> destroys;
+            };
+
+            /** counters per stripe, rounded up to whole cache lines */
+            std::size_t _stride;
+            /** storage of all stripes */
+            std::unique_ptr<counter[]> _storage;
+            /** first counter of the first stripe */
+            counter* _first;
+
+            /** returns the counters of a class in the stripe of the calling thread */
+            counter& local(std::size_t cls) {
+                static std::atomic<unsigned> next(0);
+                static thread_local std::size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % MODULEPP_STATS_STRIPES;
+                return _first[stripe * _stride + cls];
+            }
+
+            /** noncopyable */
+            class_counters(const class_counters&) = delete;
+    };
+
+    /** Counters of one class, see class_loader::stats. */
+    struct class_stats {
+        /** Name of the class */
+        std::string name;
+        /** Instances created */
+        std::uint64_t creates;
+        /** Instances destroyed through the smart pointer path or class_loader::destroy */
+        std::uint64_t destroys;
+    };
+
+    /** Counters of one library and its classes, see class_loader::stats. */
+    struct library_stats {
+        /** Path the library was loaded from */
+        std::string path;
+        /** Instances from create_unique and friends still alive */
+        long live;
+        /** Bytes mapped for the library, 0 if unknown */
+        std::size_t mappedBytes;
+        /** Time taken to open, initialize and build the library */
+        std::chrono::nanoseconds loadTime;
+        /** Classes exported by the library */
+        std::vector<class_stats> classes;
+    };
+
+    /** Statistics of all libraries of a loader at one point in time. */
+    struct loader_stats {
+        /** Loaded libraries in load order */
+        std::vector<library_stats> libraries;
+
+        /** Returns the statistics in the Prometheus text exposition format, metric names start with prefix. */
+        std::string prometheus(const std::string& prefix = "modulepp") const {
+            std::ostringstream out;
+
+            metric(out, prefix + "_library_live_instances", "gauge", "Instances of the library still alive.");
+            for (const library_stats& l : libraries) {
+                out << prefix << "_library_live_instances{library=\"" << escape(l.path) << "\"} " << l.live << "\n";
+            }
+
+            metric(out, prefix + "_library_mapped_bytes", "gauge", "Bytes mapped for the library.");
+            for (const library_stats& l : libraries) {
+                out << prefix << "_library_mapped_bytes{library=\"" << escape(l.path) << "\"} " << l.mappedBytes << "\n";
+            }
+
+            metric(out, prefix + "_library_load_seconds", "gauge", "Time taken to load the library.");
+            for (const library_stats& l : libraries) {
+                out << prefix << "_library_load_seconds{library=\"" << escape(l.path) << "\"} "
+                    << std::chrono::duration<double>(l.loadTime).count() << "\n";
+            }
+
+            metric(out, prefix + "_class_creates_total", "counter", "Instances of the class created.");
+            for (const library_stats& l : libraries) {
+                for (const class_stats& c : l.classes) {
+                    out << prefix << "_class_creates_total{library=\"" << escape(l.path) << "\",class=\"" << escape(c.name) << "\"} "
+                        << c.creates << "\n";
+                }
+            }
+
+            metric(out, prefix + "_class_destroys_total", "counter", "Instances of the class destroyed.");
+            for (const library_stats& l : libraries) {
+                for (const class_stats& c : l.classes) {
+                    out << prefix << "_class_destroys_total{library=\"" << escape(l.path) << "\",class=\"" << escape(c.name) << "\"} "
+                        << c.destroys << "\n";
+                }
+            }
+
+            return out.str();
+        }
+    private:
+        /** Writes the HELP and TYPE lines of a metric */
+        static void metric(std::ostringstream& out, const std::string& name, const char* type, const char* help) {
+            out << "# HELP " << name << " " << help << "\n";
+            out << "# TYPE " << name << " " << type << "\n";
+        }
+
+        /** Escapes a label value */
+        static std::string escape(const std::string& value) {
+            std::string result;
+            result.reserve(value.size());
+            for (char c : value) {
+                if (c == '\\' || c == '"') {
+                    result += '\\';
+                    result += c;
+                } else if (c == '\n') {
+                    result += "\\n";
+                } else {
+                    result += c;
+                }
+            }
+            return result;
+        }
+    };
+}
+
+#endif /* _MODULEPP_MODULE_STATS_HPP_ */
@@ -0,0 +1,130 @@
+/**
+ * @file module_string.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_STRING_HPP_
+#define _MODULEPP_MODULE_STRING_HPP_
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#if __cplusplus >= 201703L
+    #include <string_view>
+#endif
+
+namespace modulepp {
+    /** FNV-1a offset basis */
+    static const std::uint64_t HASH_BASIS = 14695981039346656037ULL;
+    /** FNV-1a prime */
+    static const std::uint64_t HASH_PRIME = 1099511628211ULL;
+
+    /** Compile-time FNV-1a hash of the first n characters of s. */
+    constexpr std::uint64_t hash_name(const char* s, std::size_t n, std::uint64_t h = HASH_BASIS) {
+        return (n == 0) ? h : hash_name(s + 1, n - 1, (h ^ static_cast<unsigned char>(*s)) * HASH_PRIME);
+    }
+
+    /** Runtime FNV-1a hash of the first n characters of s, identical to hash_name; continues from h. */
+    inline std::uint64_t hash_bytes(const char* s, std::size_t n, std::uint64_t h = HASH_BASIS) {
+        for (std::size_t i = 0; i < n; ++i) {
+            h = (h ^ static_cast<unsigned char>(s[i])) * HASH_PRIME;
+        }
+        return h;
+    }
+
+    /**
+     * Non-owning reference to a string.
+     *
+     * Used for lookups so callers holding a const char*, std::string or std::string_view don't
+     * have to allocate. The referenced characters have to outlive the string_ref.
+     */
+    class string_ref {
+        public:
+            /** Constructs an empty reference */
+            constexpr string_ref() : _data(""), _size(0) {}
+
+            /** Constructs a reference to the first size characters of data */
+            constexpr string_ref(const char* data, std::size_t size) : _data(data), _size(size) {}
+
+            /** Constructs a reference to a null-terminated string */
+            string_ref(const char* data) : _data(data), _size(std::strlen(data)) {}
+
+            /** Constructs a reference to a std::string */
+            string_ref(const std::string& str) : _data(str.data()), _size(str.size()) {}
+
+            #if __cplusplus >= 201703L
+            /** Constructs a reference to a std::string_view */
+            constexpr string_ref(std::string_view str) : _data(str.data()), _size(str.size()) {}
+
+            /** Converts the reference to a std::string_view */
+            constexpr operator std::string_view() const {
+                return std::string_view(_data, _size);
+            }
+            #endif
+
+            /** Returns pointer to the first character, not necessarily null-terminated */
+            constexpr const char* data() const {
+                return _data;
+            }
+
+            /** Returns number of characters referenced */
+            constexpr std::size_t size() const {
+                return _size;
+            }
+
+            /** Returns an owning copy of the referenced characters */
+            std::string str() const {
+                return std::string(_data, _size);
+            }
+
+            /** Returns the hash of the referenced characters */
+            std::uint64_t hash() const {
+                return hash_bytes(_data, _size);
+            }
+
+            inline bool operator == (const string_ref& str) const {
+                return (_size == str._size) && (std::memcmp(_data, str._data, _size) == 0);
+            }
+
+            inline bool operator != (const string_ref& str) const {
+                return !(*this == str);
+            }
+        private:
+            /** Referenced characters */
+            const char* _data;
+            /** Number of characters */
+            std::size_t _size;
+    };
+
+    /** Hash functor for containers keyed by string_ref */
+    struct string_ref_hash {
+        std::size_t operator () (const string_ref& str) const {
+            return static_cast<std::size_t>(str.hash());
+        }
+    };
+}
+
+#endif /* _MODULEPP_MODULE_STRING_HPP_ */
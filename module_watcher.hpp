@@ -0,0 +1,248 @@
+/**
+ * @file module_watcher.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_WATCHER_HPP_
+#define _MODULEPP_MODULE_WATCHER_HPP_
+
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include <unordered_map>
+#include <functional>
+#include <exception>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+
+#include "module_string.hpp"
+#include "module_library.hpp"
+
+#if defined(__LINUX__) || defined(__APPLE__) || defined(hpux) || defined(_hpux) || defined(__GNUC__)
+    #include "module_watcher_unix.hpp"
+    #define DIRECTORY_WATCH_IMPLEMENTATION directory_watch_unix
+#elif defined(_WIN32)
+    #include "module_watcher_win32.hpp"
+    #define DIRECTORY_WATCH_IMPLEMENTATION directory_watch_win32
+#else
+    static_assert( false, "No viable directory watch implementation found." );
+#endif
+
+/**
+ * Short usage example:
+ *
+ * modulepp::class_loader<MyBaseClass> loader;
+ * loader.load("./plugins/my_plugin");
+ *
+ * // reloads ./plugins/my_plugin whenever a different build is deployed
+ * modulepp::library_watcher<modulepp::class_loader<MyBaseClass>> watcher(loader, "./plugins");
+ **/
+
+namespace modulepp {
+    /** Typedef for the operating-system specific directory watch implementation. */
+    typedef DIRECTORY_WATCH_IMPLEMENTATION directory_watch;
+
+    /**
+     * Reloads libraries of a class_loader when their file in a watched directory changes.
+     *
+     * Change notifications are debounced, then the size and modification time of every library loaded
+     * from the directory is compared to the ones it was loaded with. Only if those differ the file is
+     * checksummed, and only if the checksum differs from the one of the loaded build as well the library
+     * is reloaded. The checksum is known once a check found the file unchanged since loading, a library
+     * replaced before is reloaded right away. Libraries not loaded through the loader are ignored.
+     * Where the platform reports no changes, the files are compared whenever the debounce time passed.
+     */
+    template <class L>
+    class library_watcher {
+        public:
+            /** Callback invoked with the path and the exception of a failed reload */
+            typedef std::function<void(const std::string&, std::exception_ptr)> ErrorHandler;
+
+            /** Starts watching directory on a background thread, changes settle for debounce before being checked */
+            library_watcher(L& loader, const std::string& directory,
+                    std::chrono::milliseconds debounce = std::chrono::milliseconds(250),
+                    ErrorHandler onError = ErrorHandler())
+                : _loader(loader), _directory(directory), _debounce(debounce), _onError(onError), _watch(directory), _stopping(false) {
+                check();
+                _thread = std::thread(&library_watcher::run, this);
+            }
+
+            /** Destructor, stops watching */
+            ~library_watcher() {
+                _stopping = true;
+                _thread.join();
+            }
+
+            /** Compares all libraries in the directory at once, returns the number reloaded. */
+            std::size_t check() {
+                std::lock_guard<std::mutex> lock(_mutex);
+                std::size_t reloaded = 0;
+                typename L::snapshotPtr snap = _loader.current();
+
+                for (auto &it : snap->libraries) {
+                    const std::string& path = it.second->path;
+                    if (!it.second->stamped || !inDirectory(path))
+                        continue;
+
+                    const std::string file = path + shared_library::suffix();
+                    directory_watch::stamp s;
+                    if (!directory_watch::fileStamp(file, s))
+                        continue;
+
+                    // states checked for an earlier generation of the library are of no use
+                    auto known = _files.find(path);
+                    if (known != _files.end() && known->second.loaded != it.second->stamp) {
+                        _files.erase(known);
+                        known = _files.end();
+                    }
+
+                    if (known == _files.end()) {
+                        if (s == it.second->stamp) {
+                            // unchanged since it was loaded, the checksum is the one of the loaded build
+                            _files[path] = fileState{it.second->stamp, s, checksum(file)};
+                            continue;
+                        }
+                    } else if (known->second.stamp == s) {
+                        continue;
+                    }
+
+                    // changed since it was loaded, without a checksum of the loaded build it is reloaded
+                    std::uint64_t sum = checksum(file);
+                    if (known == _files.end() || sum != known->second.checksum) {
+                        try {
+                            _loader.reload(path);
+                            ++reloaded;
+                        } catch (...) {
+                            // keep the old state, the next change is checked again
+                            if (_onError)
+                                _onError(path, std::current_exception());
+                            continue;
+                        }
+
+                        // the checksum belongs to the new generation unless the file changed again meanwhile
+                        _files.erase(path);
+                        typename L::snapshotPtr after = _loader.current();
+                        auto loaded = after->libraries.find(path);
+                        if (loaded != after->libraries.end() && loaded->second->stamped && loaded->second->stamp == s)
+                            _files[path] = fileState{s, s, sum};
+                        continue;
+                    }
+
+                    known->second.stamp = s;
+                }
+
+                return reloaded;
+            }
+        private:
+            /** Last checked state of a library file */
+            struct fileState {
+                /** Stamp the library was loaded with */
+                directory_watch::stamp loaded;
+                /** Stamp the file was checked with */
+                directory_watch::stamp stamp;
+                /** Checksum of the loaded build */
+                std::uint64_t checksum;
+            };
+
+            /** Loader whose libraries are reloaded */
+            L& _loader;
+            /** Watched directory */
+            std::string _directory;
+            /** Quiet time required after a change */
+            std::chrono::milliseconds _debounce;
+            /** Called for failed reloads */
+            ErrorHandler _onError;
+            /** Platform change notification */
+            directory_watch _watch;
+            /** Known state of the libraries */
+            std::unordered_map<std::string, fileState> _files;
+            /** Mutex serializing checks */
+            std::mutex _mutex;
+            /** Whether the watcher is being destroyed */
+            std::atomic<bool> _stopping;
+            /** Watching thread */
+            std::thread _thread;
+
+            /** Watching thread main loop */
+            void run() {
+                const std::chrono::milliseconds poll(100);
+                bool pending = false;
+                std::chrono::steady_clock::time_point last;
+
+                // without notifications the files are compared every time the debounce time passed
+                if (directory_watch::polling) {
+                    while (!_stopping) {
+                        _watch.wait(std::min(poll, _debounce));
+                        if (std::chrono::steady_clock::now() - last >= _debounce) {
+                            last = std::chrono::steady_clock::now();
+                            check();
+                        }
+                    }
+                    return;
+                }
+
+                while (!_stopping) {
+                    if (_watch.wait(pending ? std::min(poll, _debounce) : poll)) {
+                        pending = true;
+                        last = std::chrono::steady_clock::now();
+                    } else if (pending && std::chrono::steady_clock::now() - last >= _debounce) {
+                        pending = false;
+                        check();
+                    }
+                }
+            }
+
+            /** Returns true if path refers to a file in the watched directory */
+            bool inDirectory(const std::string& path) const {
+                std::size_t sep = path.find_last_of("/\\");
+                if (sep == std::string::npos)
+                    return (_directory == "." || _directory.empty());
+
+                std::size_t len = _directory.size();
+                while (len > 1 && (_directory[len - 1] == '/' || _directory[len - 1] == '\\'))
+                    --len;
+
+                return (sep == len) && (path.compare(0, len, _directory, 0, len) == 0);
+            }
+
+            /** Returns the FNV-1a hash of a files content */
+            static std::uint64_t checksum(const std::string& file) {
+                std::ifstream in(file.c_str(), std::ios::binary);
+                std::uint64_t h = HASH_BASIS;
+                char buffer[65536];
+                while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+                    h = hash_bytes(buffer, static_cast<std::size_t>(in.gcount()), h);
+                }
+                return h;
+            }
+
+            /** noncopyable */
+            library_watcher(const library_watcher&) = delete;
+    };
+}
+
+#endif /* _MODULEPP_MODULE_WATCHER_HPP_ */
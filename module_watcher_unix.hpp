@@ -0,0 +1,166 @@
+/**
+ * @file module_watcher_unix.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_WATCHER_UNIX_HPP_
+#define _MODULEPP_MODULE_WATCHER_UNIX_HPP_
+#if defined(__LINUX__) || defined(__APPLE__) || defined(hpux) || defined(_hpux) || defined(__GNUC__)
+
+#include <string>
+#include <cstdint>
+#include <thread>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+    #include <poll.h>
+    #include <sys/inotify.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    #include <sys/types.h>
+    #include <sys/event.h>
+    #include <sys/time.h>
+    #define MODULEPP_WATCH_KQUEUE
+#endif
+
+#include "module_library_exceptions.hpp"
+#include "module_probe_unix.hpp"
+
+namespace modulepp {
+    /**
+     * Directory change notification for unix systems.
+     *
+     * Uses inotify on linux and kqueue on BSD systems including OS X. kqueue only reports entries being
+     * added, removed or renamed, which is how libraries are usually deployed. Other systems have no
+     * notifications, wait only sleeps and the watcher polls the files instead, see polling.
+     */
+    class directory_watch_unix {
+        public:
+            /** Modification stamp of a file. */
+            typedef library_image_unix::stamp stamp;
+
+            /** Whether changes are never reported and files have to be checked on every timeout */
+            #if defined(__linux__) || defined(MODULEPP_WATCH_KQUEUE)
+                static const bool polling = false;
+            #else
+                static const bool polling = true;
+            #endif
+
+            /** Starts watching a directory, throws if it cannot be watched. */
+            directory_watch_unix(const std::string& directory) : fd(-1), dirFd(-1) {
+                #if defined(__linux__)
+                    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                    if (fd < 0 || inotify_add_watch(fd, directory.c_str(),
+                            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+                        close();
+                        throw libraryDirectoryException();
+                    }
+                #elif defined(MODULEPP_WATCH_KQUEUE)
+                    #if defined(O_EVTONLY)
+                        dirFd = open(directory.c_str(), O_EVTONLY);
+                    #else
+                        dirFd = open(directory.c_str(), O_RDONLY);
+                    #endif
+                    fd = kqueue();
+
+                    struct kevent change;
+                    EV_SET(&change, dirFd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+                        NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_RENAME | NOTE_DELETE, 0, nullptr);
+
+                    if (dirFd < 0 || fd < 0 || kevent(fd, &change, 1, nullptr, 0, nullptr) < 0) {
+                        close();
+                        throw libraryDirectoryException();
+                    }
+                #else
+                    struct ::stat st;
+                    if (::stat(directory.c_str(), &st) != 0) {
+                        throw libraryDirectoryException();
+                    }
+                #endif
+            }
+
+            /** Destructor */
+            ~directory_watch_unix() {
+                close();
+            }
+
+            /** Waits up to timeout for a change in the directory, returns true if one occured. */
+            bool wait(std::chrono::milliseconds timeout) {
+                #if defined(__linux__)
+                    pollfd p;
+                    p.fd = fd;
+                    p.events = POLLIN;
+                    p.revents = 0;
+                    if (poll(&p, 1, static_cast<int>(timeout.count())) <= 0) {
+                        return false;
+                    }
+
+                    // drain queued events, they are only used as a trigger
+                    char buffer[4096];
+                    while (read(fd, buffer, sizeof(buffer)) > 0) {}
+                    return true;
+                #elif defined(MODULEPP_WATCH_KQUEUE)
+                    struct kevent event;
+                    struct timespec ts;
+                    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+                    ts.tv_nsec = static_cast<long>((timeout.count() % 1000) * 1000000);
+                    return kevent(fd, nullptr, 0, &event, 1, &ts) > 0;
+                #else
+                    std::this_thread::sleep_for(timeout);
+                    return false;
+                #endif
+            }
+
+            /** Reads the stamp of a file, returns false if it doesn't exist. */
+            static bool fileStamp(const std::string& file, stamp& s) {
+                return library_image_unix::fileStamp(file, s);
+            }
+        private:
+            /** inotify or kqueue descriptor */
+            int fd;
+            /** Watched directory for kqueue */
+            int dirFd;
+
+            /** Closes all descriptors */
+            void close() {
+                if (fd >= 0) {
+                    ::close(fd);
+                    fd = -1;
+                }
+
+                if (dirFd >= 0) {
+                    ::close(dirFd);
+                    dirFd = -1;
+                }
+            }
+
+            /** Prevent copying */
+            directory_watch_unix(const directory_watch_unix&) = delete;
+    };
+}
+
+#endif  /* defined(__LINUX__) || defined(__APPLE__) || defined(hpux) || defined(_hpux) || defined(__GNUC__) */
+#endif /* _MODULEPP_MODULE_WATCHER_UNIX_HPP_ */
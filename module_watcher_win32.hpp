@@ -0,0 +1,88 @@
+/**
+ * @file module_watcher_win32.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ * @version 1.1
+ *
+ * @par License
+ *    Module++
+ *    Copyright 2014 Robin Dietrich
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ *
+ * @par License
+ *    If available in your jurisdiction, this code may be treated as if placed
+ *    in the public domain.
+ */
+
+#ifndef _MODULEPP_MODULE_WATCHER_WIN32_HPP_
+#define _MODULEPP_MODULE_WATCHER_WIN32_HPP_
+#ifdef _WIN32
+
+#include <string>
+#include <cstdint>
+#include <chrono>
+#include <Windows.h>
+
+#include "module_library_exceptions.hpp"
+#include "module_probe_win32.hpp"
+
+namespace modulepp {
+    /** Directory change notification for windows systems */
+    class directory_watch_win32 {
+        public:
+            /** Modification stamp of a file. */
+            typedef library_image_win32::stamp stamp;
+
+            /** Whether changes are never reported and files have to be checked on every timeout */
+            static const bool polling = false;
+
+            /** Starts watching a directory, throws if it cannot be watched. */
+            directory_watch_win32(const std::string& directory) {
+                handle = FindFirstChangeNotificationA(directory.c_str(), FALSE,
+                    FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE);
+
+                if (handle == INVALID_HANDLE_VALUE) {
+                    throw libraryDirectoryException();
+                }
+            }
+
+            /** Destructor */
+            ~directory_watch_win32() {
+                FindCloseChangeNotification(handle);
+            }
+
+            /** Waits up to timeout for a change in the directory, returns true if one occured. */
+            bool wait(std::chrono::milliseconds timeout) {
+                if (WaitForSingleObject(handle, static_cast<DWORD>(timeout.count())) != WAIT_OBJECT_0) {
+                    return false;
+                }
+
+                FindNextChangeNotification(handle);
+                return true;
+            }
+
+            /** Reads the stamp of a file, returns false if it doesn't exist. */
+            static bool fileStamp(const std::string& file, stamp& s) {
+                return library_image_win32::fileStamp(file, s);
+            }
+        private:
+            /** Change notification handle */
+            HANDLE handle;
+
+            /** Prevent copying */
+            directory_watch_win32(const directory_watch_win32&) = delete;
+    };
+}
+
+#endif  /* _WIN32 */
+#endif /* _MODULEPP_MODULE_WATCHER_WIN32_HPP_ */
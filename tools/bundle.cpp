@@ -0,0 +1,75 @@
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "../module_bundle.hpp"
+
+using namespace modulepp;
+
+/**
+ * Packs libraries into a bundle loaded by class_loader::load_bundle.
+ *
+ * Usage: bundle -o <bundle> <library>[:<class>,<class>...] ...
+ *
+ * Libraries are named after their file without directory and suffix. Their classes are read from the
+ * manifest unless they are listed after the path, which libraries building a factory require.
+ */
+
+namespace {
+    /** Parses a library argument into a bundle source */
+    bundle_source parseSource(const std::string& arg) {
+        bundle_source source;
+        std::string::size_type colon = arg.find(':');
+        source.file = arg.substr(0, colon);
+
+        if (colon != std::string::npos) {
+            std::string::size_type start = colon + 1;
+            while (start <= arg.size()) {
+                std::string::size_type end = arg.find(',', start);
+                if (end == std::string::npos)
+                    end = arg.size();
+                if (end > start)
+                    source.classes.push_back(arg.substr(start, end - start));
+                start = end + 1;
+            }
+        }
+
+        std::string::size_type slash = source.file.find_last_of("/\\");
+        source.name = source.file.substr(slash == std::string::npos ? 0 : slash + 1);
+        std::string::size_type dot = source.name.find('.');
+        if (dot != std::string::npos && dot != 0)
+            source.name.erase(dot);
+        return source;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string output;
+    std::vector<bundle_source> sources;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            sources.push_back(parseSource(argv[i]));
+        }
+    }
+
+    if (output.empty() || sources.empty()) {
+        std::fprintf(stderr, "usage: %s -o <bundle> <library>[:<class>,<class>...] ...\n", argv[0]);
+        return 1;
+    }
+
+    try {
+        write_bundle(output, sources);
+    } catch (std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    for (auto &source : sources) {
+        std::printf("%s: %s\n", source.name.c_str(), source.file.c_str());
+    }
+    return 0;
+}